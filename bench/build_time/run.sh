@@ -0,0 +1,18 @@
+#!/bin/sh
+# usage: run.sh [build dir] [translation units]
+# times clean builds of the generated translation units, header-only and against the library
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+DIR=${1:-$ROOT/_bench_build}
+TU=${2:-200}
+JOBS=$(nproc 2>/dev/null || echo 1)
+
+cmake -S "$ROOT" -B "$DIR" -DEZPP_BUILD_TESTS=OFF -DEZPP_BUILD_BENCH=ON -DEZPP_BENCH_TU="$TU" >/dev/null || exit 1
+
+for target in ezpp_bench_header_only ezpp_bench_library; do
+  cmake --build "$DIR" --target clean >/dev/null
+  cmake --build "$DIR" --target ezpp_static -j"$JOBS" >/dev/null || exit 1
+  begin=$(date +%s%N)
+  cmake --build "$DIR" --target $target -j"$JOBS" >/dev/null || exit 1
+  end=$(date +%s%N)
+  echo "$target: $TU TUs in $(( (end - begin) / 1000000 )) ms"
+done
@@ -16,50 +16,174 @@
 #include <ctime>
 
 #include <stdexcept>
+#include <new>
 #include <memory>
 #include <cstring>
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 
 #ifdef _MSC_VER
   #include <intrin.h>
   #define LIKELY(x)                   (x)
   #define UNLIKELY(x)                 (x)
+  #define EZPP_TLS                    __declspec(thread)
+  #define EZPP_NO_INSTRUMENT
 #else
   #define LIKELY(x)                   (__builtin_expect((x), 1))
   #define UNLIKELY(x)                 (__builtin_expect((x), 0))
+  #define EZPP_TLS                    __thread
+  #define EZPP_NO_INSTRUMENT          __attribute__((no_instrument_function))
+#endif
+
+// header-only by default, every definition is inline and the header may be included anywhere.
+// with EZPP_LIBRARY the header only declares, definitions come from the ezpp library or from
+// the one translation unit that defines EZPP_IMPLEMENTATION before including it.
+#if defined(EZPP_IMPLEMENTATION)
+  #define _EZPP_DEFINITIONS
+  #define EZPP_INLINE
+#elif !defined(EZPP_LIBRARY)
+  #define _EZPP_DEFINITIONS
+  #define EZPP_INLINE                 inline
+#endif
+
+// the registry must stay visible so that dlopen'd plugins share the one of the host process,
+// header-only executables need -rdynamic for that, the shared library works as is
+#if defined(_WIN32) && defined(EZPP_SHARED)
+  #ifdef EZPP_IMPLEMENTATION
+    #define EZPP_API                  __declspec(dllexport)
+  #else
+    #define EZPP_API                  __declspec(dllimport)
+  #endif
+#elif defined(__GNUC__)
+  #define EZPP_API                    __attribute__((visibility("default")))
+#else
+  #define EZPP_API
 #endif
 
 #define EZPP_NODE_MAX                 512
+// sites of -finstrument-functions functions, made on first call, later ones aren't profiled
+#define EZPP_FN_MAX                   1024
+// calls deeper are passed through by the hooks, see EZPP_INSTRUMENT
+#define EZPP_INSTR_DEPTH              128
+#define EZPP_HIST_BUCKETS             40
+#define EZPP_CLS_TOP_MAX              8
+#define EZPP_STACK_MAX                64
+#define EZPP_PERF_MAX                 4
+#define EZPP_RUSAGE_MAX               4
+#define EZPP_COUNTER_MAX              8
+#define EZPP_SLOW_MAX                 8
+// nodes and maps retired before a pass frees those no thread may still read
+#define EZPP_RETIRE_BATCH             64
+// microseconds between live updates of a site's shared memory record while scopes are open
+#define EZPP_SHM_PUBLISH_US           100000
+#define EZPP_TAG_MAX                  32
+// seconds of recent calls kept per site, a power of two
+#define EZPP_WINDOW_MAX               64
+// samples a thread buffers until drained, a power of two, and scopes kept with each
+#define EZPP_SAMPLE_BUF               256
+#define EZPP_SAMPLE_SCOPES            8
+// functions listed per site
+#define EZPP_SAMPLE_TOP               5
+#define EZPP_SHM_FILE_MAX             128
+#define EZPP_SHM_NAME_MAX             64
+#define EZPP_SHM_EXT_MAX              64
+
+// set in ids of ezpp::context, which share the key space of thread ids
+#define EZPP_CONTEXT_TAG              ((size_t)1 << (sizeof(size_t) * 8 - 1))
 
 #define EZPP_ADD_OPTION(option)       ::ezpp::inst().addOption(option)
 #define EZPP_REMOVE_OPTION(option)    ::ezpp::inst().removeOption(option)
 #define EZPP_SET_OUTPUT(file)         ::ezpp::inst().setOutputFileName(file)
 #define EZPP_PRINT()                  ::ezpp::inst().print()
 #define EZPP_SAVE(file)               ::ezpp::inst().save(file)
+#define EZPP_SAVE_PROFILE(file)       ::ezpp::inst().saveProfile(file)
+#define EZPP_REPORT(reporter)         ::ezpp::inst().report(reporter)
 #define EZPP_CLEAR()                  ::ezpp::inst().clear()
+#define EZPP_RESET()                  ::ezpp::inst().reset()
 #define EZPP_ENABLED()                ::ezpp::inst().enabled()
+#define EZPP_SET_FILTER(rules)        ::ezpp::inst().setFilter(rules)
+#define EZPP_ADD_FILTER(rule)         ::ezpp::inst().addFilter(rule)
+#define EZPP_LOAD_FILTER(file)        ::ezpp::inst().loadFilter(file)
+#define EZPP_CLEAR_FILTER()           ::ezpp::inst().clearFilter()
+
+// name is a string, n is added to its process wide total, to the innermost scope by EZPP_ADD
+#define EZPP_COUNT(name, n)           _EZPP_COUNTER_BASE(name, n, ::ezpp::detail::count_thread)
+#define EZPP_ADD(name, n)             _EZPP_COUNTER_BASE(name, n, ::ezpp::detail::count_scope)
+
+// calls of the innermost scope taking longer are counted and the slowest kept with their stack
+#define EZPP_BUDGET(ms)               _EZPP_BUDGET_BASE(ms)
+// the budget of scopes without EZPP_BUDGET, 0 for none
+#define EZPP_SET_BUDGET(ms)           ::ezpp::inst().setBudget((int64_t)((ms) * 1000))
+// kept with the slow calls of the current thread or context, e.g. a request id
+#define EZPP_SET_TAG(tag)             ::ezpp::detail::set_tag(tag)
+
+// a report is written to "<output file name>.<pid>.<seq>" on each signo, e.g. SIGUSR1, by a
+// helper thread, figures are reset after it if reset is set. EZPP_DUMP_SIGNAL=USR1 does the same
+#define EZPP_DUMP_ON_SIGNAL(signo, reset) ::ezpp::inst().dumpOnSignal(signo, reset)
+
+// SIGPROF samples per second of cpu time of each thread entering scopes, 0 stops, linux only,
+// executables need -rdynamic for names of their own functions. EZPP_SAMPLE=<hz> does the same
+#define EZPP_SET_SAMPLING(hz)         ::ezpp::inst().setSampling(hz)
+
+// code built with -finstrument-functions is profiled once one translation unit defines
+// EZPP_INSTRUMENT before including ezpp.hpp, 1 of every n calls per thread, 0 for none, by
+// default every call. the functions are sites named by dladdr, EZPP_FILTER rules apply to them
+// and they nest with EZPP scopes. EZPP_INSTRUMENT_SAMPLE=<n> does the same
+#define EZPP_INSTRUMENT_SAMPLE(n)     ::ezpp::inst().setInstrumentSampling(n)
 
 #ifdef _WIN32
   #define int64_t __int64
   #define PRId64 "I64d"
   #include <windows.h>
-  #define EZPP_THREAD_ID              (size_t)GetCurrentThreadId()
+  #define _EZPP_OS_THREAD_ID          (size_t)GetCurrentThreadId()
 #else
   #include <inttypes.h>
   #include <unistd.h>
   #include <sys/syscall.h>
-  #define EZPP_THREAD_ID              (size_t)syscall(SYS_gettid)
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <pthread.h>
+  #include <signal.h>
+  #include <errno.h>
+  #define _EZPP_OS_THREAD_ID          (size_t)syscall(SYS_gettid)
+#endif
+
+// key of per invocation state, the active ezpp::context or else the thread
+#define EZPP_THREAD_ID                ::ezpp::detail::exec_id()
+
+#ifdef __linux__
+  #include <sys/resource.h>
+  #include <linux/perf_event.h>
+  #include <dlfcn.h>
+  #include <ucontext.h>
+  #ifdef __GNUC__
+    #include <cxxabi.h>
+  #endif
+  #ifndef sigev_notify_thread_id
+    #define sigev_notify_thread_id    _sigev_un._tid
+  #endif
+  // MEMBARRIER_CMD_PRIVATE_EXPEDITED and its registration, linux 4.14 on
+  #define _EZPP_MEMBARRIER_PRIVATE_EXPEDITED  (1 << 3)
+  #define _EZPP_MEMBARRIER_REGISTER           (1 << 4)
 #endif
 
 //////////////////////////////////////////////////////////////////////////
 
+#define EZPP_OPT_RUSAGE               0x400
+#define EZPP_OPT_CPU_TIME             0x200
+#define EZPP_OPT_PERF_COUNTER         0x100
+
 #define EZPP_OPT_SAVE_IN_DTOR         0x80
 
 #define EZPP_OPT_SORT_BY_NAME         0x40
 #define EZPP_OPT_SORT_BY_CALL         0x20
 #define EZPP_OPT_SORT_BY_COST         0x10
 
+#define EZPP_OPT_CLS_DETAIL           0x08
+#define EZPP_OPT_SHM                  0x04
+
 #define EZPP_OPT_FORCE_ENABLE         0x02
 #define EZPP_OPT_FORCE_DISABLE        0x01
 
@@ -74,6 +198,8 @@
 #define EZPP_EX_IN_LOOP(desc)         _EZPP_AUX_BASE(ex_il_, EZPP_NODE_IN_LOOP, desc)
 #define EZPP_DO()                     _EZPP_AUX_BASE(do_, EZPP_NODE_DIRECT_OUTPUT, "")
 #define EZPP_EX_DO(desc)              _EZPP_AUX_BASE(ex_do_, EZPP_NODE_DIRECT_OUTPUT, desc)
+#define EZPP_CPU()                    _EZPP_AUX_BASE(cpu_, EZPP_NODE_CPU_TIME, "")
+#define EZPP_EX_CPU(desc)             _EZPP_AUX_BASE(ex_cpu_, EZPP_NODE_CPU_TIME, desc)
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -89,6 +215,25 @@
 #define EZPP_BEGIN_EX_DO(x, desc)     _EZPP_NO_AUX_BEGIN_BASE(cc_ex_do_##x, EZPP_NODE_DIRECT_OUTPUT, desc)
 #define EZPP_END_EX_DO(x)             _EZPP_NO_AUX_END_BASE(cc_ex_do_##x)
 
+#define EZPP_BEGIN_CPU(x)             _EZPP_NO_AUX_BEGIN_BASE(cc_cpu_##x, EZPP_NODE_CPU_TIME, "")
+#define EZPP_END_CPU(x)               _EZPP_NO_AUX_END_BASE(cc_cpu_##x)
+
+#define EZPP_BEGIN_EX_CPU(x, desc)    _EZPP_NO_AUX_BEGIN_BASE(cc_ex_cpu_##x, EZPP_NODE_CPU_TIME, desc)
+#define EZPP_END_EX_CPU(x)            _EZPP_NO_AUX_END_BASE(cc_ex_cpu_##x)
+
+//////////////////////////////////////////////////////////////////////////
+
+#define EZPP_LOCK(m)                  _EZPP_LOCK_BASE(m, "")
+#define EZPP_LOCK_EX(m, desc)         _EZPP_LOCK_BASE(m, desc)
+
+//////////////////////////////////////////////////////////////////////////
+
+// s is an ::ezpp::span lvalue, e.g. a member of the request handed from thread to thread
+#define EZPP_SPAN_START(s)            _EZPP_SPAN_START_BASE(s, "")
+#define EZPP_SPAN_START_EX(s, desc)   _EZPP_SPAN_START_BASE(s, desc)
+#define EZPP_SPAN_MARK(s)             (s).mark()
+#define EZPP_SPAN_END(s)              (s).end()
+
 //////////////////////////////////////////////////////////////////////////
 
 #define EZPP_CLS_REGISTER()           _EZPP_CLS_REGISTER_BASE()
@@ -119,6 +264,9 @@
 
 //////////////////////////////////////////////////////////////////////////
 
+#define EZPP_NODE_SPAN                0x40
+#define EZPP_NODE_CPU_TIME            0x20
+#define EZPP_NODE_CLS_DETAIL          0x10
 #define EZPP_NODE_IN_LOOP             0x08
 #define EZPP_NODE_DIRECT_OUTPUT       0x04
 #define EZPP_NODE_AUTO_START          0x02
@@ -126,8 +274,41 @@
 
 //////////////////////////////////////////////////////////////////////////
 
+#define EZPP_PERF_NONE                0
+#define EZPP_PERF_HW                  1 // cycles, instructions, cache-misses, branch-misses
+#define EZPP_PERF_SW                  2 // context-switches, page-faults
+
+// shared memory segment "/ezpp.<pid>" (/dev/shm on linux), see ezpp::shm
+#define EZPP_SHM_PREFIX               "/ezpp."
+#define EZPP_SHM_MAGIC                0x5050455a // "ZEPP"
+#define EZPP_SHM_VERSION              2
+
+// binary since version 3, versions 1 and 2 were tab separated text and still load
+#define EZPP_PROFILE_MAGIC            "EZPPPROF"
+#define EZPP_PROFILE_VERSION          4
+
+//////////////////////////////////////////////////////////////////////////
+
+#if __cplusplus >= 201103L || _MSC_VER >= 1900
+  #define EZPP_CONSTEXPR              constexpr
+  // forces the hash of file and line to be folded by the compiler
+  #define _EZPP_SITE_HASH             ::ezpp::detail::const_hash< ::ezpp::detail::site_hash(__FILE__, __LINE__)>::value
+#else
+  #define EZPP_CONSTEXPR
+  #define _EZPP_SITE_HASH             ::ezpp::detail::site_hash(__FILE__, __LINE__)
+#endif
+
+#define EZPP_FNV_BASIS                14695981039346656037ULL
+#define EZPP_FNV_PRIME                1099511628211ULL
+
 #if __cplusplus >= 201103L || _MSC_VER >= 1700
   #include <atomic>
+  #include <mutex>
+  #include <utility>
+  #include <type_traits>
+  #if __cplusplus >= 201703L || _MSVC_LANG >= 201703L
+    #include <shared_mutex>
+  #endif
 #else
 namespace std {
 
@@ -281,6 +462,14 @@ namespace std {
   #endif
     }
 
+    T exchange(T new_val, memory_order order = memory_order_seq_cst) {
+  #ifdef _MSC_VER
+      return interlocked<T>::exchange(&value_, new_val);
+  #else
+      return __atomic_exchange_n(&value_, new_val, order);
+  #endif
+    }
+
     T load(memory_order order = memory_order_seq_cst) const {
   #ifdef _MSC_VER
       return interlocked<T>::add(const_cast<volatile T*>(&value_), 0);
@@ -306,29 +495,43 @@ namespace std {
 
 namespace ezpp {
 
+  // all durations are in microseconds
   #ifdef _WIN32
     namespace detail {
-      LARGE_INTEGER init_freq()
+      inline LARGE_INTEGER init_freq()
       {
         LARGE_INTEGER freq;
         QueryPerformanceFrequency(&freq);
         return freq;
       }
     }
-    int64_t time_now()
+    inline int64_t time_now()
     {
       static LARGE_INTEGER freq = detail::init_freq();
       LARGE_INTEGER cnter;
       QueryPerformanceCounter(&cnter);
-      return cnter.QuadPart / freq.QuadPart * 1000;
+      return cnter.QuadPart / freq.QuadPart * 1000000 + cnter.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+    }
+    inline int64_t time_cpu()
+    {
+      FILETIME creation, exit, kernel, user;
+      GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+      return ((int64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) / 10
+        + ((int64_t)user.dwHighDateTime << 32 | user.dwLowDateTime) / 10;
     }
   #else
-    #include <sys/time.h>
-    int64_t time_now()
+    // both clocks go through vdso where the kernel provides it, a syscall otherwise
+    inline int64_t time_now()
+    {
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_nsec / 1000 + (int64_t)ts.tv_sec * 1000000;
+    }
+    inline int64_t time_cpu()
     {
-      timeval tv;
-      gettimeofday(&tv, 0);
-      return tv.tv_usec / 1000 + tv.tv_sec * 1000;
+      timespec ts;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      return ts.tv_nsec / 1000 + (int64_t)ts.tv_sec * 1000000;
     }
   #endif
 
@@ -349,7 +552,7 @@ namespace ezpp {
   */
   namespace folly {
 
-    size_t nextPowTwo(size_t v) {
+    inline size_t nextPowTwo(size_t v) {
     #ifdef _MSC_VER
       unsigned long x = 0;
       _BitScanForward(&x, v - 1);
@@ -723,300 +926,3992 @@ namespace ezpp {
 
   } // namespace folly
 
-  class node {
-  public:
-    friend class ezpp;
-
-    inline const std::string& name() const { return _name; }
-    inline int64_t callCnt() const         { return _callCnt; }
-    inline int64_t costTime() const        { return _totalCost; }
-    inline bool checkInUse()               { return _totalRefCnt > 0; }
-    inline void setReleaseUntilEnd()       { _releaseUntilEnd = true; }
-    inline void endLine(int endLine)       { _endLine = endLine; }
+  class node;
+  class ezpp;
+  class reporter;
 
-    void begin(size_t c12n);
-    void call(size_t c12n);
-    void end(size_t c12n);
+  EZPP_API ezpp& inst();
 
-    void output(FILE* fp);
+  namespace detail {
+    inline void full_fence() {
+    #if __cplusplus >= 201103L || _MSC_VER >= 1700
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    #elif defined(_MSC_VER)
+      MemoryBarrier();
+    #else
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    #endif
+    }
 
-    void setDesc(const char* file, int line, const std::string& name, const std::string& ext) {
-      _file = file; _line = line; _name = name; _ext = ext;
+    inline void compiler_fence() {
+    #if __cplusplus >= 201103L || _MSC_VER >= 1700
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    #elif defined(_MSC_VER)
+      _ReadWriteBarrier();
+    #else
+      __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    #endif
     }
 
-  protected:
-    static inline void atomic_init(void* raw, const folly::MutableAtom<int64_t>*) {
-      *(int64_t*)raw = 0;
+    // spin locks this thread holds plus 1 while it constructs ezpp, the instrumentation hooks
+    // keep out of ezpp while it is not 0 as they could take the same lock again
+    EZPP_NO_INSTRUMENT inline int& instr_off() {
+      static EZPP_TLS int off;
+      return off;
     }
 
-    size_t _id;
+    class spin_lock {
+    public:
+      spin_lock() : _locked(0) {}
+      EZPP_NO_INSTRUMENT inline void lock() {
+        ++instr_off();
+        int expected = 0;
+        while (!_locked.compare_exchange_strong(expected, 1)) {
+          expected = 0;
+        }
+      }
+      EZPP_NO_INSTRUMENT inline bool try_lock() {
+        ++instr_off();
+        int expected = 0;
+        if (!_locked.compare_exchange_strong(expected, 1)) {
+          --instr_off();
+          return false;
+        }
+        return true;
+      }
+      EZPP_NO_INSTRUMENT inline void unlock() {
+        _locked.store(0);
+        --instr_off();
+      }
 
-    typedef folly::AtomicUnorderedMap<size_t, folly::MutableAtom<int64_t> > time_map;
-    time_map _beginMap;
-    time_map _costMap;
-    time_map _refMap;
+    private:
+      std::atomic<int> _locked;
+    };
 
-    std::atomic<int64_t> _start;
-    std::atomic<int64_t> _totalCost;
-    std::atomic<int64_t> _callCnt;
-    std::atomic<int64_t> _totalRefCnt;
+    class spin_guard {
+    public:
+      EZPP_NO_INSTRUMENT explicit spin_guard(spin_lock& l) : _l(l) { _l.lock(); }
+      EZPP_NO_INSTRUMENT ~spin_guard() { _l.unlock(); }
 
-    unsigned char _flags;
-    bool _releaseUntilEnd;
+    private:
+      spin_guard(const spin_guard&);
+      spin_guard& operator=(const spin_guard&);
+      spin_lock& _l;
+    };
 
-    const char* _file;
-    int         _line;
-    int         _endLine;
-    std::string _name; // __FUNCTION__ \ typeid(*this).name()
-    std::string _ext;
+    // one active scope in the per-thread shadow stack
+    struct frame {
+      node*   n;
+      // wall clock on enter and the time spent in scopes nested in this one
+      int64_t begin;
+      int64_t child;
+      // suspended time of the context on enter
+      int64_t suspendBegin;
+      // microseconds, 0 for none, see EZPP_BUDGET
+      int64_t budget;
+      // EZPP_ADD, counters[i] is valid if bit i of counterMask is set
+      unsigned counterMask;
+      int64_t  counters[EZPP_COUNTER_MAX];
+      // counters of the enclosing scope, restored on leave
+      int64_t allocCnt;
+      int64_t allocBytes;
+      int64_t freeCnt;
+      // clocks on enter, valid if cpu is set
+      bool    cpu;
+      int64_t wallBegin;
+      int64_t cpuBegin;
+      // pmu counters on enter, valid if perf is set
+      bool    perf;
+      int64_t perfBegin[EZPP_PERF_MAX];
+      // rusage on enter, valid if ru is set
+      bool    ru;
+      int64_t ruBegin[EZPP_RUSAGE_MAX];
+    };
 
-  private:
-    explicit node(size_t id, size_t c12n, unsigned char flags);
-  };
+    struct perf_group {
+      int fds[EZPP_PERF_MAX];
+      int cnt;
+    };
 
-  class node_aux {
-  public:
-    node_aux(node *n = 0, size_t c12n = 0) : _n(n), _c12n(c12n) {}
-    inline void set(node *n, size_t c12n) { _n = n; _c12n = c12n; }
-    ~node_aux() { if (_n) _n->end(_c12n); }
+    // one flow of execution, a thread or a fiber / coroutine switched in on it, see ezpp::context
+    struct exec_ctx {
+      size_t  id; // 0 for the thread's own
+      int     depth;
+      frame   stack[EZPP_STACK_MAX];
+      // depth + 1 under the innermost scope open without a frame, e.g. its site is filtered out,
+      // 0 for none, see node_aux::unframed
+      int     unframed;
+      // counters charged to the innermost scope
+      int64_t allocCnt;
+      int64_t allocBytes;
+      int64_t freeCnt;
+      // time spent switched out
+      int64_t suspended;
+      // see EZPP_SET_TAG
+      char    tag[EZPP_TAG_MAX];
+      // nodes of the instrumented calls open in here, 0 for calls not recorded, see EZPP_INSTRUMENT
+      int     instrDepth;
+      int     instrOverflow;
+      node*   instrStack[EZPP_INSTR_DEPTH];
+    };
 
-  private:
-    node *_n;
-	size_t _c12n;
-  };
+    // generation of ezpp a thread read node maps or nodes in, 0 outside, see ezpp::retire
+    struct epoch_slot {
+      std::atomic<int64_t> active;
+      epoch_slot*          next;
+    };
 
-  class ezpp {
-  public:
-    static node* create(size_t id, size_t c12n, unsigned char flags, const char* file, int line, const std::string& name, const std::string& ext);
-    static void release(const std::pair<size_t, folly::MutableData<node*> >& node_pair);
+    // EZPP_COUNT totals of one thread, written by it only and summed up by readers
+    struct counter_block {
+      std::atomic<int64_t> values[EZPP_COUNTER_MAX];
+      counter_block*       next;
+    };
 
-    void addOption(unsigned char optModify);
-    void removeOption(unsigned char optModify);
+  #ifdef __linux__
+    // pc interrupted by SIGPROF and the innermost scopes open then, by site id
+    struct sample {
+      void*  pc;
+      int    depth;
+      size_t scopes[EZPP_SAMPLE_SCOPES];
+    };
 
-    inline void setOutputFileName(const std::string &file) { _file = file; }
-    std::string getOutputFileName();
+    // filled by the signal handler of its thread, drained under ezpp::_sampleLock, handed to
+    // the next thread once its own has exited
+    struct sample_block {
+      std::atomic<uint32_t> head;
+      std::atomic<uint32_t> tail;
+      std::atomic<int64_t>  dropped;
+      std::atomic<int>      used;
+      bool                  armed;
+      timer_t               timer;
+      sample                slots[EZPP_SAMPLE_BUF];
+      sample_block*         next;
+
+      inline uint32_t pending() const {
+        return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+      }
+    };
+  #else
+    struct sample_block;
+  #endif
 
-    void print();
-    void save(const std::string& file = "");
-    void clear();
-    inline bool enabled() { return _enabled; }
+    struct tls_ctx {
+      int      mute; // ezpp's own allocations are not charged
+      size_t   tid;  // cached _EZPP_OS_THREAD_ID, 0 until first asked
+      // created on first EZPP_COUNT, kept after the thread exits
+      counter_block* counters;
+      // created on first epoch_guard, kept after the thread exits
+      epoch_slot* slot;
+      int         guardDepth;
+      // sampling rate the thread's timer runs at, see ezpp::setSampling
+      sample_block* samples;
+      int           sampleHz;
+      // the active context, 0 for own
+      exec_ctx* cur;
+      exec_ctx  own;
+      // 0: not opened yet, 1: opened, -1: unavailable on this thread
+      int        perfState;
+      perf_group perf;
+    };
 
-    static size_t gen_id() {
-      static std::atomic<size_t> id(0);
-      return ++id;
+    inline tls_ctx& tls() {
+      static EZPP_TLS tls_ctx ctx;
+      return ctx;
     }
 
-  protected:
-    ezpp(int/* dummy */);
-    ~ezpp();
-
-  protected:
-    friend class node;
-    friend ezpp& inst();
-
-    static int init() {
-      std::srand((unsigned int)time(0));
-      return 0;
+    inline exec_ctx& exec(tls_ctx& t) {
+      return t.cur ? *t.cur : t.own;
     }
 
-    void removeDoNode(size_t id);
+    inline size_t exec_id() {
+      tls_ctx& t = tls();
+      if (t.cur) {
+        return t.cur->id;
+      }
+      if (UNLIKELY(!t.tid)) {
+        t.tid = _EZPP_OS_THREAD_ID;
+      }
+      return t.tid;
+    }
 
-    void output(FILE* fp);
-    static void outputTime(FILE* fp, int64_t duration);
+    void count_thread(int idx, int64_t n);
+    void count_scope(int idx, int64_t n);
 
-    typedef folly::AtomicUnorderedMap<size_t, folly::MutableData<node*> > node_map;
+    // state of the instrumentation hooks on a thread, the calls open are kept per exec_ctx
+    struct instr_ctx {
+      int      busy; // in a hook, what ezpp calls meanwhile isn't recorded
+      uint32_t seed; // xorshift, counting calls would pick the same functions every time
+    };
 
-    node_map _doMap;
-    node_map _nodeMap;
+    // maps and nodes of ezpp read inside are not freed until the outermost guard is left
+    class epoch_guard {
+    public:
+      epoch_guard();
+      ~epoch_guard();
 
-    int64_t _begin;
+    private:
+      epoch_guard(const epoch_guard&);
+      epoch_guard& operator=(const epoch_guard&);
+      tls_ctx& _t;
+    };
 
-    unsigned char _option;
+    // to the frame of the enclosing scope, none if it has no frame
+    inline void budget(int64_t us) {
+      exec_ctx& ctx = exec(tls());
+      if (ctx.depth && ctx.unframed != ctx.depth + 1) {
+        ctx.stack[ctx.depth - 1].budget = us;
+      }
+    }
 
-    bool _enabled;
+    inline void set_tag(const char* tag) {
+      exec_ctx& ctx = exec(tls());
+      strncpy(ctx.tag, tag ? tag : "", EZPP_TAG_MAX - 1);
+      ctx.tag[EZPP_TAG_MAX - 1] = 0;
+    }
 
-    std::string _file;
-  };
+    inline void on_alloc(size_t size) {
+      tls_ctx& t = tls();
+      if (!t.mute) {
+        exec_ctx& ctx = exec(t);
+        ++ctx.allocCnt;
+        ctx.allocBytes += size;
+      }
+    }
 
-  ezpp& inst() {
-    static ezpp inst(ezpp::init());
-    return inst;
-  }
+    inline void on_free() {
+      tls_ctx& t = tls();
+      if (!t.mute) {
+        ++exec(t).freeCnt;
+      }
+    }
 
-  namespace detail {
-    static bool NameSort(node* lhs, node* rhs) {
-      return lhs->name() < rhs->name();
+  #ifdef __linux__
+    inline int perf_event_open(uint32_t type, uint64_t config, int group) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      // user space only for hardware events, which is allowed with perf_event_paranoid <= 2
+      attr.exclude_kernel = type == PERF_TYPE_HARDWARE;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
     }
 
-    static bool CallCntSort(node* lhs, node* rhs) {
-      return lhs->callCnt() < rhs->callCnt();
+    inline void perf_close(perf_group& g) {
+      while (g.cnt > 0) {
+        close(g.fds[--g.cnt]);
+      }
     }
 
-    static bool CostTimeSort(node* lhs, node* rhs) {
-      return lhs->costTime() < rhs->costTime();
+    // opens a counter group of the given kind for calling thread
+    inline bool perf_open(perf_group& g, int kind) {
+      static const uint64_t hw[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+      static const uint64_t sw[] = { PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_PAGE_FAULTS };
+      uint32_t type = kind == EZPP_PERF_HW ? PERF_TYPE_HARDWARE : PERF_TYPE_SOFTWARE;
+      const uint64_t* configs = kind == EZPP_PERF_HW ? hw : sw;
+      int cnt = kind == EZPP_PERF_HW ? 4 : kind == EZPP_PERF_SW ? 2 : 0;
+      g.cnt = 0;
+      for (int i = 0; i < cnt; ++i) {
+        int fd = perf_event_open(type, configs[i], i ? g.fds[0] : -1);
+        if (fd < 0) {
+          perf_close(g);
+          return false;
+        }
+        g.fds[g.cnt++] = fd;
+      }
+      return cnt > 0;
     }
-  }
 
-  // protected
-  void
-  ezpp::outputTime(FILE* fp, int64_t duration) {
-    double seconds = (double)duration / 1000;
-    double minute = seconds / 60;
-    double hour = minute / 60;
+    inline bool perf_read(const perf_group& g, int64_t* values) {
+      uint64_t buf[1 + EZPP_PERF_MAX];
+      if (read(g.fds[0], buf, sizeof(buf)) < (ssize_t)(sizeof(uint64_t) * (1 + g.cnt))) {
+        return false;
+      }
+      for (int i = 0; i < g.cnt; ++i) {
+        values[i] = (int64_t)buf[1 + i];
+      }
+      return true;
+    }
 
-    if ((int)hour > 0) {
-      fprintf(fp, "%.0f hour%s, ", hour, hour > 1 ? "s" : "");
+    // hardware counters if the pmu is exposed, otherwise software events (containers, vms)
+    inline int perf_probe() {
+      perf_group g;
+      if (perf_open(g, EZPP_PERF_HW)) {
+        perf_close(g);
+        return EZPP_PERF_HW;
+      }
+      if (perf_open(g, EZPP_PERF_SW)) {
+        perf_close(g);
+        return EZPP_PERF_SW;
+      }
+      return EZPP_PERF_NONE;
     }
 
-    minute = (double)((int64_t)minute % 60);
-    if ((int)minute > 0) {
-      fprintf(fp, "%.0f min%s, ", minute, minute > 1 ? "s" : "");
+    inline void perf_thread_exit(void* ctx) {
+      perf_close(static_cast<tls_ctx*>(ctx)->perf);
     }
 
-    seconds -= duration / 60000;
-    if (seconds < 1) {
-      fprintf(fp, "%2.2f ms", seconds * 1000);
+    // counters of calling thread are opened on its first scope, and closed on its exit
+    inline bool perf_ready(tls_ctx& ctx, int kind) {
+      if (LIKELY(ctx.perfState)) {
+        return ctx.perfState > 0;
+      }
+      static pthread_key_t key;
+      static int keyCreated = pthread_key_create(&key, perf_thread_exit);
+      ctx.perfState = !keyCreated && perf_open(ctx.perf, kind) ? 1 : -1;
+      if (ctx.perfState > 0) {
+        pthread_setspecific(key, &ctx);
+      }
+      return ctx.perfState > 0;
     }
-    else {
-      fprintf(fp, "%2.2f sec%s", seconds, seconds > 1 ? "s" : "");
+  #else
+    inline int perf_probe()                                   { return EZPP_PERF_NONE; }
+    inline bool perf_ready(tls_ctx&, int)                     { return false; }
+    inline bool perf_read(const perf_group&, int64_t*)        { return false; }
+  #endif
+
+    // voluntary / involuntary context switches, minor / major faults of calling thread
+    inline bool thread_rusage(int64_t* values) {
+    #if defined(__linux__) && defined(RUSAGE_THREAD)
+      rusage ru;
+      if (getrusage(RUSAGE_THREAD, &ru)) {
+        return false;
+      }
+      values[0] = ru.ru_nvcsw;
+      values[1] = ru.ru_nivcsw;
+      values[2] = ru.ru_minflt;
+      values[3] = ru.ru_majflt;
+      return true;
+    #else
+      (void)values;
+      return false;
+    #endif
     }
-  }
 
-  // protected
-  ezpp::ezpp(int/* dummy */)
-    : _doMap(EZPP_NODE_MAX)
-    , _nodeMap(EZPP_NODE_MAX)
-    , _begin(0)
-    , _option(0)
-    , _enabled(false)
-    , _file()
-  {}
+    class alloc_mute {
+    public:
+      alloc_mute() { ++tls().mute; }
+      ~alloc_mute() { --tls().mute; }
+    };
 
-  // protected
-  ezpp::~ezpp() {
-    print();
-    if (_enabled && (_option & EZPP_OPT_SAVE_IN_DTOR)) {
-      save();
+    inline size_t log2_bucket(int64_t v) {
+      if (v <= 0) {
+        return 0;
+      }
+    #ifdef _MSC_VER
+      unsigned long x = 0;
+      _BitScanReverse64(&x, (unsigned __int64)v);
+      size_t b = (size_t)x + 1;
+    #else
+      size_t b = (size_t)(64 - __builtin_clzll((unsigned long long)v));
+    #endif
+      return b < EZPP_HIST_BUCKETS ? b : EZPP_HIST_BUCKETS - 1;
     }
-    clear();
-  }
 
-  // public static
-  node* 
-  ezpp::create(size_t id, size_t c12n, unsigned char flags, const char* file, int line, const std::string& name, const std::string& ext) {
-    if (!inst().enabled() || !flags) {
-      return 0;
+    // 64 bit FNV-1a, usable in constant expressions since C++11
+    EZPP_CONSTEXPR inline unsigned long long fnv1a(const char* s, unsigned long long h = EZPP_FNV_BASIS) {
+      return *s ? fnv1a(s + 1, (h ^ (unsigned char)*s) * EZPP_FNV_PRIME) : h;
     }
-    node_map& map = (flags & EZPP_NODE_DIRECT_OUTPUT) ? inst()._doMap : inst()._nodeMap;
-    node_map::const_iterator it = map.find(id);
-    if (it != map.cend()) {
-      it->second.data->call(c12n);
-      return it->second.data;
+
+    EZPP_CONSTEXPR inline unsigned long long fnv1a(unsigned int v, unsigned long long h, int bytes = 4) {
+      return bytes ? fnv1a(v >> 8, (h ^ (v & 0xff)) * EZPP_FNV_PRIME, bytes - 1) : h;
     }
-    node* n = new node(id, c12n, flags);
-    n->setDesc(file, line, name, ext);
-    map.insert(id, n);
-    return n;
-  }
 
-  // public static
-  void
-  ezpp::release(const std::pair<size_t, folly::MutableData<node*> >& node_pair) {
-    if (!node_pair.second.data->checkInUse()) {
-      delete node_pair.second.data;
+    EZPP_CONSTEXPR inline const char* file_name(const char* s, const char* last) {
+      return *s ? file_name(s + 1, (*s == '/' || *s == '\\') ? s + 1 : last) : last;
     }
-    else {
-      node_pair.second.data->setReleaseUntilEnd();
+
+    // the build directory stays out, a site keeps its id wherever the tree is checked out
+    EZPP_CONSTEXPR inline unsigned long long site_hash(const char* file, int line) {
+      return fnv1a((unsigned int)line, fnv1a(file_name(file, file)));
     }
+
+    template <unsigned long long h>
+    struct const_hash {
+      static const unsigned long long value = h;
+    };
   }
 
-  void
-  ezpp::output(FILE* fp) {
-    if (_nodeMap.cbegin() != _nodeMap.cend()) {
-      fprintf(fp, "========== Easy Performance Profiler Report ==========\r\n");
+  // log2 buckets: [0] holds 0, [i] holds [2^(i-1), 2^i), the last one holds the rest
+  class histogram {
+  public:
+    histogram() { reset(); }
+
+    inline void add(int64_t v)                 { ++_buckets[detail::log2_bucket(v)]; }
+    inline int64_t bucketCnt(size_t i) const   { return _buckets[i]; }
+    static inline int64_t bucketLower(size_t i) { return i ? (int64_t)1 << (i - 1) : 0; }
+    static inline int64_t bucketUpper(size_t i) { return (int64_t)1 << i; }
 
-      std::vector<node *> array;
-      for (node_map::const_iterator it = _nodeMap.cbegin(); it != _nodeMap.cend(); ++it) {
-        array.push_back(it->second.data);
+    void reset() {
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        _buckets[i] = 0;
       }
+    }
 
-      if ((_option & EZPP_OPT_SORT_BY_NAME) || !(_option & EZPP_OPT_SORT)) {
-        std::sort(array.begin(), array.end(), detail::NameSort);
-        fprintf(fp, "\r\n     [Sort By Name]\r\n\r\n");
-        for (unsigned i = 0; i < array.size(); ++i) {
-          fprintf(fp, "No.%u\r\n", i + 1);
-          array[i]->output(fp);
-        }
+    int64_t count() const {
+      int64_t cnt = 0;
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        cnt += _buckets[i];
       }
-      
-      if (_option & EZPP_OPT_SORT_BY_CALL) {
-        std::sort(array.begin(), array.end(), detail::CallCntSort);
-        fprintf(fp, "\r\n     [Sort By Call]\r\n\r\n");
-        for (unsigned i = 0; i < array.size(); ++i) {
-          fprintf(fp, "No.%u\r\n", i + 1);
-          array[i]->output(fp);
-        }
+      return cnt;
+    }
+
+    // upper bound of the bucket where the p-th (0~1) value falls
+    int64_t percentile(double p) const {
+      int64_t buckets[EZPP_HIST_BUCKETS];
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        buckets[i] = _buckets[i];
       }
+      return percentile(buckets, p);
+    }
 
-      if (_option & EZPP_OPT_SORT_BY_COST) {
-        std::sort(array.begin(), array.end(), detail::CostTimeSort);
-        fprintf(fp, "\r\n     [Sort By Cost]\r\n\r\n");
-        for (unsigned i = 0; i < array.size(); ++i) {
-          fprintf(fp, "No.%u\r\n", i + 1);
-          array[i]->output(fp);
+    // same over plain bucket counts, e.g. copied out of a snapshot
+    static int64_t percentile(const int64_t* buckets, double p) {
+      int64_t cnt = 0;
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        cnt += buckets[i];
+      }
+      if (!cnt) {
+        return 0;
+      }
+      int64_t rank = (int64_t)(p * cnt + 0.5), seen = 0;
+      if (rank < 1) {
+        rank = 1;
+      }
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+          return bucketUpper(i);
         }
       }
-
-      fprintf(fp, "====== [Total Time Elapsed] ");
-      outputTime(fp, time_now() - _begin);
-      time_t timep;
-      time(&timep);
-      char tmp[64];
-      strftime(tmp, sizeof(tmp), "%Y-%m-%d %H:%M:%S", localtime(&timep));
-      fprintf(fp, " ======\r\n====== [Generate Date] %s ======\r\n", tmp);
+      return bucketUpper(EZPP_HIST_BUCKETS - 1);
     }
-  }
 
-  // public
-  void 
-  ezpp::print() {
-    output(stdout);
-  }
+  private:
+    std::atomic<int64_t> _buckets[EZPP_HIST_BUCKETS];
+  };
 
-  // public
-  std::string
-  ezpp::getOutputFileName() {
-    return _file.empty() ? "ezpp.log" : _file;
-  }
+  // calls, time and durations of the last EZPP_WINDOW_MAX seconds in a ring of per second buckets.
+  // the first update in a new second takes the bucket over, updates racing that are dropped
+  class window {
+  public:
+    struct stat {
+      // time covered, at most the seconds asked for
+      int64_t span;
+      int64_t callCnt;
+      int64_t totalCost;
+      int64_t duration[EZPP_HIST_BUCKETS];
+
+      stat() : span(0), callCnt(0), totalCost(0) {
+        memset(duration, 0, sizeof(duration));
+      }
 
-  // public
-  void
-  ezpp::save(const std::string& file/* = ""*/) {
-    FILE* fp = fopen(file.empty() ? getOutputFileName().c_str() : file.c_str(), "wb+");
-    if(!fp) return;
-    output(fp);
-    fclose(fp);
-  }
+      inline double rate() const             { return span > 0 ? (double)callCnt * 1000000 / span : 0.0; }
+      inline int64_t mean() const            { return callCnt ? totalCost / callCnt : 0; }
+      inline int64_t percentile(double p) const { return histogram::percentile(duration, p); }
+    };
 
-  // public
-  void
-  ezpp::clear() {
-    std::for_each(_doMap.cbegin(), _doMap.cend(), ezpp::release);
-    _doMap.clear();
-    std::for_each(_nodeMap.cbegin(), _nodeMap.cend(), ezpp::release);
-    _nodeMap.clear();
-    _begin = time_now();
-  }
+    window() { reset(); }
 
-  // protected
-  void
-  ezpp::removeDoNode(size_t id) {
-    _doMap.erase(id);
-  }
+    inline void add(int64_t now, int64_t elapsed) {
+      int64_t sec = now / 1000000;
+      bucket& b = _buckets[sec & (EZPP_WINDOW_MAX - 1)];
+      if (UNLIKELY(b.sec.load(std::memory_order_relaxed) != sec) && !rotate(b, sec)) {
+        return;
+      }
+      ++b.callCnt;
+      b.totalCost += elapsed;
+      ++b.duration[detail::log2_bucket(elapsed)];
+    }
+
+    // the current second so far and the seconds before it, the span lies between seconds and
+    // seconds + 1 then and rates are exact over it, none before since
+    void get(int64_t now, int seconds, int64_t since, stat& out) const {
+      seconds = clamp(seconds);
+      out.span = covered(now, seconds, since);
+      int64_t cur = now / 1000000;
+      for (int64_t s = cur - seconds; s <= cur; ++s) {
+        const bucket& b = _buckets[s & (EZPP_WINDOW_MAX - 1)];
+        if (b.sec.load(std::memory_order_acquire) != s) {
+          continue;
+        }
+        int64_t callCnt = b.callCnt, totalCost = b.totalCost;
+        int64_t duration[EZPP_HIST_BUCKETS];
+        for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+          duration[i] = b.duration[i];
+        }
+        // taken over by a later second while copied
+        if (b.sec.load(std::memory_order_acquire) != s) {
+          continue;
+        }
+        out.callCnt += callCnt;
+        out.totalCost += totalCost;
+        for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+          out.duration[i] += duration[i];
+        }
+      }
+    }
+
+    // time the seconds asked for cover up to now, none before since
+    static int64_t covered(int64_t now, int seconds, int64_t since) {
+      int64_t from = (now / 1000000 - clamp(seconds)) * 1000000;
+      return now - (since > from ? since : from);
+    }
+
+    void reset() {
+      for (size_t i = 0; i < EZPP_WINDOW_MAX; ++i) {
+        bucket& b = _buckets[i];
+        b.sec = -1;
+        b.callCnt = 0;
+        b.totalCost = 0;
+        for (size_t j = 0; j < EZPP_HIST_BUCKETS; ++j) {
+          b.duration[j] = 0;
+        }
+      }
+    }
+
+  private:
+    struct bucket {
+      // second the figures belong to, -1 before the first one and -2 while taken over
+      std::atomic<int64_t> sec;
+      std::atomic<int64_t> callCnt;
+      std::atomic<int64_t> totalCost;
+      std::atomic<int64_t> duration[EZPP_HIST_BUCKETS];
+    };
+
+    static int clamp(int seconds) {
+      return seconds < 1 ? 1 : seconds > EZPP_WINDOW_MAX - 1 ? EZPP_WINDOW_MAX - 1 : seconds;
+    }
+
+    // false if another thread is taking the bucket over or it already holds a later second
+    bool rotate(bucket& b, int64_t sec) {
+      int64_t old = b.sec.load(std::memory_order_relaxed);
+      if (old >= sec || old == -2 || !b.sec.compare_exchange_strong(old, -2)) {
+        return b.sec.load(std::memory_order_relaxed) == sec;
+      }
+      b.callCnt.store(0, std::memory_order_relaxed);
+      b.totalCost.store(0, std::memory_order_relaxed);
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        b.duration[i].store(0, std::memory_order_relaxed);
+      }
+      b.sec.store(sec, std::memory_order_release);
+      return true;
+    }
+
+    bucket _buckets[EZPP_WINDOW_MAX];
+  };
+
+  // per-class aggregation of object lifetimes, constant memory regardless of object count
+  class obj_tracker {
+  public:
+    struct entry {
+      size_t  obj;
+      int64_t lifetime;
+    };
+
+    obj_tracker() : _live(0), _peak(0), _dead(0), _lifeSum(0), _lifeMax(0), _topMin(-1), _topCnt(0) {}
+
+    inline int64_t live() const    { return _live; }
+    inline int64_t peak() const    { return _peak; }
+    inline int64_t dead() const    { return _dead; }
+    inline int64_t lifeSum() const { return _lifeSum; }
+    inline int64_t lifeMax() const { return _lifeMax; }
+    inline const histogram& lifeHist() const { return _lifeHist; }
+
+    void born() {
+      int64_t live = ++_live;
+      int64_t peak = _peak;
+      while (live > peak && !_peak.compare_exchange_strong(peak, live));
+    }
+
+    void died(size_t obj, int64_t lifetime) {
+      --_live;
+      ++_dead;
+      _lifeSum += lifetime;
+      _lifeHist.add(lifetime);
+      int64_t max = _lifeMax;
+      while (lifetime > max && !_lifeMax.compare_exchange_strong(max, lifetime));
+      if (lifetime > _topMin) {
+        addTop(obj, lifetime);
+      }
+    }
+
+    // longest-lived objects, sorted by lifetime desc
+    std::vector<entry> top() const {
+      detail::spin_guard guard(_topLock);
+      std::vector<entry> array(_top, _top + _topCnt);
+      std::sort(array.begin(), array.end(), LifetimeSort);
+      return array;
+    }
+
+    // forgets the dead, the live ones stay counted
+    void reset() {
+      _peak = _live.load();
+      _dead = 0;
+      _lifeSum = 0;
+      _lifeMax = 0;
+      _lifeHist.reset();
+      detail::spin_guard guard(_topLock);
+      _topCnt = 0;
+      _topMin = -1;
+    }
+
+  protected:
+    static bool LifetimeSort(const entry& lhs, const entry& rhs) {
+      return lhs.lifetime > rhs.lifetime;
+    }
+
+    void addTop(size_t obj, int64_t lifetime) {
+      detail::spin_guard guard(_topLock);
+      size_t slot = _topCnt;
+      if (_topCnt < EZPP_CLS_TOP_MAX) {
+        ++_topCnt;
+      }
+      else {
+        slot = 0;
+        for (size_t i = 1; i < _topCnt; ++i) {
+          if (_top[i].lifetime < _top[slot].lifetime) {
+            slot = i;
+          }
+        }
+        if (_top[slot].lifetime >= lifetime) {
+          return;
+        }
+      }
+      _top[slot].obj = obj;
+      _top[slot].lifetime = lifetime;
+      if (_topCnt == EZPP_CLS_TOP_MAX) {
+        int64_t min = lifetime;
+        for (size_t i = 0; i < _topCnt; ++i) {
+          if (_top[i].lifetime < min) {
+            min = _top[i].lifetime;
+          }
+        }
+        _topMin = min;
+      }
+    }
+
+    std::atomic<int64_t> _live;
+    std::atomic<int64_t> _peak;
+    std::atomic<int64_t> _dead;
+    std::atomic<int64_t> _lifeSum;
+    std::atomic<int64_t> _lifeMax;
+    histogram            _lifeHist;
+
+    std::atomic<int64_t>      _topMin;
+    mutable detail::spin_lock _topLock;
+    entry                     _top[EZPP_CLS_TOP_MAX];
+    size_t                    _topCnt;
+  };
+
+  // slowest calls over budget with the scopes they ran in, constant memory regardless of call count
+  class slow_log {
+  public:
+    struct entry {
+      size_t             site;
+      int64_t            duration;
+      // time_now() when it ended
+      int64_t            when;
+      unsigned long long thread;
+      // site ids of the enclosing scopes, outermost first
+      int                depth;
+      size_t             stack[EZPP_STACK_MAX];
+      char               tag[EZPP_TAG_MAX];
+    };
+
+    slow_log() : _min(-1), _cnt(0) {}
+
+    inline bool slower(int64_t duration) const { return duration > _min; }
+
+    void add(const entry& e) {
+      detail::spin_guard guard(_lock);
+      size_t slot = _cnt;
+      if (_cnt < EZPP_SLOW_MAX) {
+        ++_cnt;
+      }
+      else {
+        slot = 0;
+        for (size_t i = 1; i < _cnt; ++i) {
+          if (_entries[i].duration < _entries[slot].duration) {
+            slot = i;
+          }
+        }
+        if (_entries[slot].duration >= e.duration) {
+          return;
+        }
+      }
+      _entries[slot] = e;
+      if (_cnt == EZPP_SLOW_MAX) {
+        int64_t min = e.duration;
+        for (size_t i = 0; i < _cnt; ++i) {
+          if (_entries[i].duration < min) {
+            min = _entries[i].duration;
+          }
+        }
+        _min = min;
+      }
+    }
+
+    // sorted by duration desc
+    std::vector<entry> top() {
+      detail::spin_guard guard(_lock);
+      std::vector<entry> array(_entries, _entries + _cnt);
+      std::sort(array.begin(), array.end(), DurationSort);
+      return array;
+    }
+
+    void reset() {
+      detail::spin_guard guard(_lock);
+      _cnt = 0;
+      _min = -1;
+    }
+
+  protected:
+    friend class ezpp;
+
+    static bool DurationSort(const entry& lhs, const entry& rhs) {
+      return lhs.duration > rhs.duration;
+    }
+
+    std::atomic<int64_t> _min;
+    detail::spin_lock    _lock;
+    entry                _entries[EZPP_SLOW_MAX];
+    size_t               _cnt;
+  };
+
+  // live counters for readers outside the process: one header and fixed-size records, a record
+  // per site. descriptions are written before recordCnt covers them and never change, the stat
+  // is guarded by a seqlock, seq is odd while a writer is inside.
+  namespace shm {
+    struct stat {
+      int64_t id;
+      int64_t callCnt;
+      int64_t totalCost;
+      int64_t cpuCost;
+      int64_t allocCnt;
+      int64_t allocBytes;
+      int64_t updated;
+      int64_t selfCost;
+      // per call durations, bucket i counts [2^(i-1), 2^i) microseconds like ezpp::histogram
+      int64_t duration[EZPP_HIST_BUCKETS];
+    };
+
+    struct record {
+      std::atomic<unsigned int> seq;
+      int  line;
+      stat data;
+      char file[EZPP_SHM_FILE_MAX];
+      char name[EZPP_SHM_NAME_MAX];
+      char ext[EZPP_SHM_EXT_MAX];
+    };
+
+    struct header {
+      std::atomic<unsigned int> magic; // set last
+      unsigned int version;
+      unsigned int headerSize;
+      unsigned int recordSize;
+      unsigned int recordMax;
+      std::atomic<unsigned int> recordCnt;
+      int64_t pid;
+      int64_t started;
+    };
+
+    inline void acquire_fence() {
+    #if __cplusplus >= 201103L || _MSC_VER >= 1700
+      std::atomic_thread_fence(std::memory_order_acquire);
+    #elif defined(_MSC_VER)
+      MemoryBarrier();
+    #else
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    #endif
+    }
+
+    // copies a consistent stat out of r, false if every try raced a writer
+    inline bool read(const record& r, stat& out, int tries = 64) {
+      for (int i = 0; i < tries; ++i) {
+        unsigned int seq = r.seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+          continue;
+        }
+        memcpy(&out, (const void*)&r.data, sizeof(out));
+        acquire_fence();
+        if (r.seq.load(std::memory_order_relaxed) == seq) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    class EZPP_API segment {
+    public:
+      segment() : _hdr(0), _size(0), _owner(false), _pid(0) {}
+      ~segment() { close(); }
+
+      // writer side, creates and maps "/ezpp.<pid>" of the calling process
+      bool create();
+      // reader side, maps the segment of pid read-only
+      bool open(int pid);
+      // reader side, maps a copy of a segment saved to a file, e.g. cp /dev/shm/ezpp.<pid>
+      bool load(const std::string& file);
+      // unmaps, and the owner removes the segment
+      void close();
+      // unmaps only, e.g. the mapping a forked child inherited from its parent
+      void detach();
+
+      // writer side, takes the next free record or returns 0 when full
+      record* alloc(size_t id, const char* file, int line, const std::string& name, const std::string& ext);
+
+      inline bool valid() const              { return _hdr != 0; }
+      inline const header* hdr() const       { return _hdr; }
+      inline unsigned int count() const      { return _hdr ? _hdr->recordCnt.load(std::memory_order_acquire) : 0; }
+      inline const record& at(unsigned int i) const {
+        return *(const record*)((const char*)_hdr + _hdr->headerSize + (size_t)i * _hdr->recordSize);
+      }
+
+      static std::string name(int pid);
+
+    private:
+      segment(const segment&);
+      segment& operator=(const segment&);
+
+      bool attach(int fd);
+
+      header* _hdr;
+      size_t  _size;
+      bool    _owner;
+      int     _pid;
+    };
+  }
+
+  class EZPP_API node {
+  public:
+    friend class ezpp;
+    friend class site_view;
+
+    inline const std::string& name() const { return _name; }
+    inline int64_t callCnt() const         { return _callCnt; }
+    inline int64_t costTime() const        { return _totalCost; }
+    inline bool checkInUse()               { return _totalRefCnt > 0; }
+    inline void setReleaseUntilEnd()       { _releaseUntilEnd = true; }
+    inline void endLine(int endLine)       { _endLine = endLine; }
+
+    void begin(size_t c12n);
+    // false when the node was retired meanwhile, the caller looks the site up again
+    bool call(size_t c12n);
+    void end(size_t c12n);
+    void destroy(size_t obj, int64_t birth);
+    // scopes of spans don't belong to any thread, see span
+    int64_t spanBegin();
+    void spanEnd(int64_t begin, int64_t queued);
+
+    // calls and durations of the last seconds since profiling began or the last reset, see
+    // window::get
+    void recent(int seconds, window::stat& out, int64_t now = time_now()) const;
+
+    void output(FILE* fp);
+
+    void setDesc(const char* file, int line, const std::string& name, const std::string& ext) {
+      _file = file; _line = line; _name = name; _ext = ext;
+    }
+
+  protected:
+    static inline void atomic_init(void* raw, const folly::MutableAtom<int64_t>*) {
+      *(int64_t*)raw = 0;
+    }
+
+    inline bool aggregated() const {
+      return (_flags & (EZPP_NODE_CLS | EZPP_NODE_CLS_DETAIL)) == EZPP_NODE_CLS;
+    }
+
+    void idle();
+    void retire();
+    // zeroes the figures, scopes still open count from now
+    void reset(int64_t now);
+    void enter(int64_t now);
+    void leave(size_t c12n, int64_t now);
+    // refs are the scopes still open, their time so far is included. false when skipped
+    bool publish(int64_t now, int64_t refs);
+
+    size_t _id;
+
+    typedef folly::AtomicUnorderedMap<size_t, folly::MutableAtom<int64_t> > time_map;
+    time_map _beginMap;
+    time_map _costMap;
+    time_map _refMap;
+
+    int64_t              _created;
+    std::atomic<int64_t> _start;
+    std::atomic<int64_t> _totalCost;
+    std::atomic<int64_t> _callCnt;
+    std::atomic<int64_t> _totalRefCnt;
+
+    std::atomic<int64_t> _allocCnt;
+    std::atomic<int64_t> _allocBytes;
+    std::atomic<int64_t> _freeCnt;
+
+    std::atomic<int64_t> _cpuCnt;
+    std::atomic<int64_t> _cpuCost;
+    std::atomic<int64_t> _cpuWall;
+
+    int                  _perfKind;
+    std::atomic<int64_t> _perfCnt;
+    std::atomic<int64_t> _perf[EZPP_PERF_MAX];
+
+    struct rusage_stat {
+      mutable std::atomic<int64_t> values[EZPP_RUSAGE_MAX];
+    };
+    static inline void rusage_init(void* raw, const rusage_stat*) {
+      rusage_stat* stat = new (raw) rusage_stat;
+      for (size_t i = 0; i < EZPP_RUSAGE_MAX; ++i) {
+        stat->values[i] = 0;
+      }
+    }
+    typedef folly::AtomicUnorderedMap<size_t, rusage_stat> rusage_map;
+
+    std::atomic<int64_t> _ruCnt;
+    std::atomic<int64_t> _ru[EZPP_RUSAGE_MAX];
+    // per thread breakdown, created on first use
+    std::atomic<rusage_map*> _ruMap;
+
+    obj_tracker _objs;
+
+    // from the shadow stack, time outside and inside of nested scopes and per call durations
+    std::atomic<int64_t> _selfCost;
+    std::atomic<int64_t> _childCost;
+    histogram            _duration;
+    // the same per second for the last EZPP_WINDOW_MAX seconds, see recent(). allocated with
+    // the first call ending, never for EZPP_NODE_DIRECT_OUTPUT
+    std::atomic<window*> _window;
+    void addRecent(int64_t now, int64_t elapsed);
+    // time the context of a scope was switched out, see context
+    std::atomic<int64_t> _suspendCost;
+    // time spans waited until marked, see span::mark
+    std::atomic<int64_t> _queueCost;
+    // EZPP_ADD totals, by counter id
+    std::atomic<int64_t> _counters[EZPP_COUNTER_MAX];
+    // last budget seen, calls over it and the slowest of them, created on first one
+    std::atomic<int64_t>   _budget;
+    std::atomic<int64_t>   _overCnt;
+    std::atomic<slow_log*> _slow;
+    void overBudget(const detail::exec_ctx& ctx, int i, int64_t elapsed, int64_t now);
+
+    // calls and time per enclosing scope, keyed by its site id, created on first nested call
+    struct edge_stat {
+      mutable std::atomic<int64_t> callCnt;
+      mutable std::atomic<int64_t> totalCost;
+    };
+    static inline void edge_init(void* raw, const edge_stat*) {
+      edge_stat* stat = new (raw) edge_stat;
+      stat->callCnt = 0;
+      stat->totalCost = 0;
+    }
+    typedef folly::AtomicUnorderedMap<size_t, edge_stat> edge_map;
+
+    std::atomic<edge_map*> _edgeMap;
+    void addEdge(size_t parent, int64_t elapsed);
+
+    // record in the shared memory segment, 0 unless EZPP_OPT_SHM was on when created
+    shm::record* _shm;
+    // time_now() of the last publish
+    std::atomic<int64_t> _published;
+
+    unsigned char _flags;
+    bool _releaseUntilEnd;
+    // handed to ezpp::retire, once
+    std::atomic<int> _retired;
+
+    const char* _file;
+    int         _line;
+    int         _endLine;
+    std::string _name; // __FUNCTION__ \ typeid(*this).name()
+    std::string _ext;
+
+  private:
+    explicit node(size_t id, size_t c12n, unsigned char flags);
+    ~node() { delete _ruMap.load(); delete _edgeMap.load(); delete _slow.load(); delete _window.load(); }
+  };
+
+  class node_aux {
+  public:
+    node_aux(node *n = 0, size_t c12n = 0) : _n(n), _c12n(c12n), _unframed(-1) {}
+    inline void set(node *n, size_t c12n) {
+      _n = n;
+      _c12n = c12n;
+      detail::exec_ctx& ctx = detail::exec(detail::tls());
+      // not created, or deeper than EZPP_STACK_MAX
+      if (!n || !ctx.depth || ctx.stack[ctx.depth - 1].n != n) {
+        unframed();
+      }
+    }
+    // the scope pushed no frame, EZPP_BUDGET in it mustn't reach the frame of the enclosing one
+    inline void unframed() {
+      detail::exec_ctx& ctx = detail::exec(detail::tls());
+      _unframed = ctx.unframed;
+      ctx.unframed = ctx.depth + 1;
+    }
+    ~node_aux() {
+      if (_n) _n->end(_c12n);
+      if (_unframed >= 0) detail::exec(detail::tls()).unframed = _unframed;
+    }
+
+  private:
+    node *_n;
+	size_t _c12n;
+    int _unframed;
+  };
+
+  class cls_aux {
+  public:
+    cls_aux() : _n(0), _obj(0), _birth(0) {}
+    // copies are not tracked unless their constructor runs EZPP_CLS_INIT
+    cls_aux(const cls_aux&) : _n(0), _obj(0), _birth(0) {}
+    cls_aux& operator=(const cls_aux&) { return *this; }
+    inline void set(node *n, size_t obj) { _n = n; _obj = obj; if (n) _birth = time_now(); }
+    ~cls_aux() { if (_n) _n->destroy(_obj, _birth); }
+
+  private:
+    node   *_n;
+    size_t  _obj;
+    int64_t _birth;
+  };
+
+  // execution context of a fiber or coroutine. the scheduler switches it in on the thread about to
+  // run it and out when it yields, scopes then key on the context instead of the thread and may end
+  // on another thread than they began on. time switched out is reported apart from running time,
+  // cpu time, perf counters and rusage are not measured for scopes open across a switch
+  class EZPP_API context {
+  public:
+    context();
+
+    inline size_t id() const               { return _exec.id; }
+    // contexts may nest on a thread, e.g. a coroutine resumed by a fiber
+    void enter();
+    // back to what was active before enter() on calling thread
+    void leave();
+
+  protected:
+    detail::exec_ctx  _exec;
+    detail::exec_ctx* _prev;
+    int64_t           _leftAt;
+
+  private:
+    context(const context&);
+    context& operator=(const context&);
+  };
+
+  // switched in for the lifetime of the guard, e.g. around swapcontext in a scheduler
+  class context_guard {
+  public:
+    explicit context_guard(context& c) : _c(c) { _c.enter(); }
+    ~context_guard() { _c.leave(); }
+
+  private:
+    context_guard(const context_guard&);
+    context_guard& operator=(const context_guard&);
+    context& _c;
+  };
+
+  // an operation started on one thread and ended on another, e.g. accepted by an I/O thread and
+  // finished by a worker. spans of a site are aggregated like scopes, with the time until mark()
+  // reported as queued. a span is moved from thread to thread, never copied, one still running
+  // when destroyed ends
+  class EZPP_API span {
+  public:
+    span() : _n(0), _begin(0), _mark(0) {}
+  #if __cplusplus >= 201103L || _MSC_VER >= 1700
+    span(span&& s) : _n(0), _begin(0), _mark(0) { take(s); }
+    span& operator=(span&& s) {
+      if (this != &s) {
+        end();
+        take(s);
+      }
+      return *this;
+    }
+    span(const span&) = delete;
+    span& operator=(const span&) = delete;
+  #endif
+    ~span() { end(); }
+
+    inline bool running() const            { return _n != 0; }
+    // see EZPP_SPAN_START, ends what was running
+    void start(node* n);
+    // queued until now, e.g. when a worker picks the request up
+    void mark();
+    void end();
+
+  protected:
+    inline void take(span& s) {
+      _n = s._n;
+      _begin = s._begin;
+      _mark = s._mark;
+      s._n = 0;
+    }
+
+    node*         _n;
+    int64_t       _begin;
+    int64_t       _mark;
+
+  #if !(__cplusplus >= 201103L || _MSC_VER >= 1700)
+  private:
+    // no moves before c++11, a span stays where it was started
+    span(const span&);
+    span& operator=(const span&);
+  #endif
+  };
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+  // co_await ezpp::await_in(ctx, awaitable) in a coroutine running in ctx, which starts with an
+  // ezpp::context_guard: ctx is switched out while suspended and in on the thread resuming it
+  template <typename A>
+  struct awaiter {
+    context& ctx;
+    A        a;
+    // await_suspend doesn't run when the awaitable is ready, ctx stays in then
+    bool     left;
+
+    bool await_ready() { return a.await_ready(); }
+
+    template <typename H>
+    decltype(auto) await_suspend(H h) {
+      ctx.leave();
+      left = true;
+      return a.await_suspend(h);
+    }
+
+    decltype(auto) await_resume() {
+      if (left) {
+        left = false;
+        ctx.enter();
+      }
+      return a.await_resume();
+    }
+  };
+
+  template <typename A>
+  awaiter<typename std::decay<A>::type> await_in(context& ctx, A&& a) {
+    return awaiter<typename std::decay<A>::type>{ ctx, std::forward<A>(a), false };
+  }
+#endif
+
+  // one instrumented location, a function static registered on its first execution
+  class EZPP_API site {
+  public:
+    // hash of file name and line, see _EZPP_SITE_HASH, name and ext are folded in here
+    site(unsigned long long hash, const char* file, int line, const std::string& name, const std::string& ext);
+
+    inline size_t id() const               { return _id; }
+    inline const char* file() const        { return _file; }
+    inline int line() const                { return _line; }
+    inline const std::string& name() const { return _name; }
+    inline const std::string& ext() const  { return _ext; }
+    inline bool enabled() const            { return _enabled.load(std::memory_order_relaxed) != 0; }
+    inline site* next() const              { return _next; }
+    // same place in the source and same description
+    bool same(const site& s) const;
+
+  protected:
+    friend class ezpp;
+
+    size_t           _id;
+    const char*      _file;
+    int              _line;
+    std::string      _name;
+    std::string      _ext;
+    std::atomic<int> _enabled;
+    site*            _next;
+  };
+
+  // include / exclude rules of sites, see ezpp::setFilter
+  class EZPP_API site_filter {
+  public:
+    // "[+|-][file:|name:|ext:]glob", a rule without field matches any of them
+    bool add(const std::string& spec);
+    void clear()                   { _rules.clear(); }
+    bool match(const site& s) const;
+
+    static bool glob(const char* pattern, const char* str);
+
+  protected:
+    struct rule {
+      bool        include;
+      char        field; // 'f', 'n', 'e' or 0 for any
+      std::string pattern;
+    };
+    std::vector<rule> _rules;
+  };
+
+  // acquisition statistics of one lock site, an EZPP_LOCK location or named ezpp::mutex instances
+  class EZPP_API lock_site {
+  public:
+    lock_site(const char* file, int line, const std::string& name, const std::string& ext)
+      : _file(file), _line(line), _name(name), _ext(ext)
+      , _acquireCnt(0), _contendedCnt(0), _waitTime(0), _waitMax(0), _holdCnt(0), _holdTime(0)
+    {}
+
+    inline const std::string& name() const { return _name; }
+    inline int64_t acquireCnt() const      { return _acquireCnt; }
+    inline int64_t contendedCnt() const    { return _contendedCnt; }
+    inline int64_t waitTime() const        { return _waitTime; }
+
+    inline void acquired() {
+      ++_acquireCnt;
+    }
+
+    inline void acquired(int64_t wait) {
+      ++_acquireCnt;
+      ++_contendedCnt;
+      _waitTime += wait;
+      int64_t max = _waitMax;
+      while (wait > max && !_waitMax.compare_exchange_strong(max, wait));
+    }
+
+    inline void released(int64_t hold) {
+      ++_holdCnt;
+      _holdTime += hold;
+    }
+
+    void reset() {
+      _acquireCnt = _contendedCnt = _waitTime = _waitMax = _holdCnt = _holdTime = 0;
+    }
+
+    void output(FILE* fp);
+
+  protected:
+    const char* _file;
+    int         _line;
+    std::string _name;
+    std::string _ext;
+
+    std::atomic<int64_t> _acquireCnt;
+    std::atomic<int64_t> _contendedCnt;
+    std::atomic<int64_t> _waitTime;
+    std::atomic<int64_t> _waitMax;
+    std::atomic<int64_t> _holdCnt;
+    std::atomic<int64_t> _holdTime;
+  };
+
+  // per site figures of a run, written by ezpp::saveProfile and compared with diff()
+  struct EZPP_API profile {
+    struct entry {
+      size_t      id;
+      std::string file;
+      int         line;
+      std::string name;
+      std::string ext;
+      int64_t     callCnt;
+      int64_t     totalCost;
+      int64_t     selfCost;
+      int64_t     cpuCost;
+      int64_t     allocCnt;
+      int64_t     allocBytes;
+      int64_t     duration[EZPP_HIST_BUCKETS];
+      // time per thread id, per object for classes, none in files before version 4 and in merges of processes
+      std::map<unsigned long long, int64_t> threadCost;
+
+      entry() : id(0), line(0), callCnt(0), totalCost(0), selfCost(0), cpuCost(0), allocCnt(0), allocBytes(0) {
+        memset(duration, 0, sizeof(duration));
+      }
+
+      inline int64_t mean() const            { return callCnt ? totalCost / callCnt : 0; }
+      inline int64_t p99() const             { return histogram::percentile(duration, 0.99); }
+      // line numbers and build directories move between versions, name, ext and file name don't
+      std::string key() const;
+    };
+
+    // matched sites carry both sides, new ones no before and vanished ones no after
+    struct delta {
+      const entry* before;
+      const entry* after;
+      inline int64_t impact() const {
+        int64_t d = (after ? after->totalCost : 0) - (before ? before->totalCost : 0);
+        return d < 0 ? -d : d;
+      }
+    };
+
+    // a scope entered while the one of site parent was open, callers without scope are not seen
+    struct edge {
+      size_t  parent;
+      size_t  child;
+      int64_t callCnt;
+      int64_t totalCost;
+
+      edge() : parent(0), child(0), callCnt(0), totalCost(0) {}
+    };
+
+    profile() : elapsed(0), processCnt(1) {}
+
+    std::vector<entry> entries;
+    std::vector<edge>  edges;
+    int64_t            elapsed;
+    // processes summed up in here, see merge()
+    int64_t            processCnt;
+
+    bool save(const std::string& file) const;
+    bool load(const std::string& file);
+
+    // adds the figures of another process, sites by id (key and line for version 1 files),
+    // edges by both ends, elapsed is the longest of them as the processes ran side by side.
+    // per thread figures are dropped unless one side holds no process yet, e.g. processCnt = 0
+    void merge(const profile& other);
+
+    // sorted by impact on total time, largest first
+    static std::vector<delta> diff(const profile& before, const profile& after);
+    static void output(FILE* fp, const profile& before, const profile& after, const std::vector<delta>& deltas);
+  };
+
+  // a function SIGPROF interrupted inside a site, see site_view::samples
+  struct sampled_func {
+    std::string name;
+    int64_t     cnt;
+  };
+
+  class EZPP_API ezpp {
+  public:
+    static node* create(const site& s, size_t c12n, unsigned char flags);
+    static void release(const std::pair<size_t, folly::MutableData<node*> >& node_pair);
+
+    void addOption(unsigned int optModify);
+    void removeOption(unsigned int optModify);
+
+    // "%p" is replaced by the pid, "%h" by the host name and "%%" by '%', e.g. "ezpp.%h.%p.log"
+    inline void setOutputFileName(const std::string &file) { _file = file; }
+    std::string getOutputFileName();
+
+    void print();
+    void save(const std::string& file = "");
+    // hands a view of the figures to r, print() and save() go through text_reporter
+    void report(reporter& r);
+    // figures of every site for profile::diff, EZPP_PROFILE=<file> saves them at exit too,
+    // file is expanded as the output file name, so workers of one server don't clash with "%p"
+    profile snapshot();
+    bool saveProfile(const std::string& file);
+    // the same over the last seconds, up to EZPP_WINDOW_MAX - 1, of sites called in them. elapsed
+    // is the time covered, there are no self, cpu and alloc figures and no edges
+    profile recent(int seconds);
+    // drops every site and starts over, scopes open on other threads keep their nodes until they
+    // end and nodes are freed once no thread may still read them
+    void clear();
+    // zeroes the figures in place and keeps sites, cheap enough for a timer under load. scopes
+    // open across it count from the reset on
+    void reset();
+    inline bool enabled() { return _enabled; }
+
+    // rules separated by ';' or new lines, first match wins, sites matching none are enabled
+    // unless there is an include rule, e.g. "-file:*/third_party/*;+name:Conn*"
+    void setFilter(const std::string& rules);
+    void addFilter(const std::string& rule);
+    bool loadFilter(const std::string& file);
+    void clearFilter();
+
+    // id of a counter name for EZPP_COUNT and EZPP_ADD, -1 once EZPP_COUNTER_MAX names are taken
+    int counterId(const char* name);
+    // process wide total of EZPP_COUNT, EZPP_ADD outside of any scope included
+    int64_t counter(const std::string& name);
+
+    // microseconds, see EZPP_SET_BUDGET
+    inline void setBudget(int64_t us)      { _budget.store(us, std::memory_order_relaxed); }
+    // slowest calls over budget of all sites
+    std::vector<slow_log::entry> slowest() { return _slowest.top(); }
+
+    // the handler only writes signo to a pipe, false on windows or if the helper can't start
+    bool dumpOnSignal(int signo, bool reset = false);
+    // threads start or stop sampling on their next scope, false where there is no SIGPROF timer
+    bool setSampling(int hz);
+    inline void setInstrumentSampling(int n) { _instrEvery = n; }
+    // by the EZPP_INSTRUMENT hooks, the node of a call of fn begun or 0 if not recorded
+    node* instrEnter(void* fn, uint32_t rnd);
+
+    // sites are owned by ezpp and live until exit, same file, line and name share one
+    lock_site* lockSite(const char* file, int line, const std::string& name, const std::string& ext = "");
+
+  protected:
+    ezpp(int/* dummy */);
+    ~ezpp();
+
+  protected:
+    friend class node;
+    friend class site;
+    friend class lock_site;
+    friend struct profile;
+    friend class view;
+    friend class site_view;
+    friend class text_reporter;
+    friend ezpp& inst();
+    friend void detail::count_thread(int idx, int64_t n);
+    friend class detail::epoch_guard;
+
+    // runs under the guard of inst(), an instrumented call in here would wait for it
+    EZPP_NO_INSTRUMENT static int init() {
+      ++detail::instr_off();
+      std::srand((unsigned int)time(0));
+      return 0;
+    }
+
+    void removeDoNode(size_t id);
+
+    static std::string expandName(const std::string& file);
+
+    // a forked child starts over with figures, segment and counters of its own
+    static void forkPrepare();
+    static void forkParent();
+    static void forkChild();
+
+    void output(FILE* fp);
+    static void outputTime(FILE* fp, int64_t duration);
+    static void outputBytes(FILE* fp, int64_t bytes);
+    // 1000 based, e.g. "12.50 M"
+    static void outputCount(FILE* fp, double cnt);
+    const site* findSite(size_t id);
+    // process wide total of a counter id
+    int64_t counterTotal(int i);
+
+    inline void chargeUnscoped(int64_t allocCnt, int64_t allocBytes, int64_t freeCnt) {
+      if (allocCnt || freeCnt) {
+        _allocCnt += allocCnt;
+        _allocBytes += allocBytes;
+        _freeCnt += freeCnt;
+      }
+    }
+
+    typedef folly::AtomicUnorderedMap<size_t, folly::MutableData<node*> > node_map;
+
+    // replaced as a whole by clear(), read under a detail::epoch_guard
+    std::atomic<node_map*> _doMap;
+    std::atomic<node_map*> _nodeMap;
+
+    // p is freed by del once no thread is in a guard entered before it was retired
+    void retire(void* p, void (*del)(void*));
+    // frees what no guard may see any more, until nothing is left if wait is set
+    void reclaim(bool wait);
+    // orders the guard entries of all threads before what the calling thread reads next
+    void heavyBarrier();
+    // what is not kept per site, by clear() and reset()
+    void resetGlobals(int64_t now);
+    static void deleteNode(void* p);
+    static void deleteMap(void* p);
+
+    struct retired {
+      void*   p;
+      void  (*del)(void*);
+      int64_t gen;
+    };
+    detail::spin_lock                 _retireLock;
+    std::vector<retired>              _retired;
+    std::atomic<int64_t>              _gen;
+    std::atomic<detail::epoch_slot*>  _slots;
+    // readers get away with a compiler barrier, see heavyBarrier
+    bool                              _membarrier;
+
+    detail::spin_lock    _clearLock;
+    // last reset() or clear(), scopes begun before count from here
+    std::atomic<int64_t> _resetAt;
+
+  #ifndef _WIN32
+    static void onDumpSignal(int signo);
+    static void* dumpLoop(void*);
+    bool startDump();
+    void stopDump();
+    void dump(int signo);
+
+    detail::spin_lock _dumpLock;
+    // read by the helper thread, written by the handler, -1 until the first dumpOnSignal
+    int               _dumpPipe[2];
+    pthread_t         _dumpThread;
+    // by signal number
+    uint64_t          _dumpSignals;
+    uint64_t          _dumpResets;
+    int               _dumpSeq;
+  #endif
+
+  #ifdef __linux__
+    static void onSample(int signo, siginfo_t* info, void* uc);
+    // thread exit, the timer goes and the block is free for the next thread
+    static void releaseSamples(void* p);
+    void armSampling(detail::tls_ctx& t);
+    // into _samples, unless another thread is at it and wait isn't set
+    void drainSamples(bool wait);
+
+    detail::spin_lock                   _sampleLock;
+    std::atomic<int>                    _sampleHz;
+    bool                                _sampleInit;
+    // the SIGPROF handler installed before ours, chained to
+    struct sigaction                    _samplePrev;
+    pthread_key_t                       _sampleKey;
+    std::atomic<detail::sample_block*>  _sampleBlocks;
+    int64_t                             _sampleDropped;
+    // by site and pc, each scope open counts a sample
+    typedef std::map<void*, int64_t> pc_map;
+    std::map<size_t, pc_map>            _samples;
+  #endif
+    // samples inside a site, and its hottest functions by samples desc
+    int64_t sampled(size_t id, std::vector<sampled_func>& funcs);
+
+    // sites of instrumented functions by address, kept until exit like those of the macros
+    const site* fnSite(void* fn);
+
+    typedef folly::AtomicUnorderedMap<size_t, folly::MutableData<site*> > fn_map;
+    detail::spin_lock _fnLock;
+    fn_map            _fnSites;
+    int               _fnCnt;
+    std::atomic<int>  _instrEvery;
+
+    void registerSite(site* s);
+    void applyFilter();
+
+    detail::spin_lock _filterLock;
+    site_filter       _filter;
+    site*             _sites;
+
+    typedef std::map<std::string, lock_site*> lock_map;
+    detail::spin_lock _lockLock;
+    lock_map          _lockMap;
+
+    detail::spin_lock                    _counterLock;
+    std::string                          _counterNames[EZPP_COUNTER_MAX];
+    std::atomic<int>                     _counterCnt;
+    std::atomic<detail::counter_block*>  _counterBlocks;
+
+    // one record per site, kept across clear()
+    shm::record* shmRecord(const site& s);
+
+    typedef std::map<size_t, shm::record*> shm_map;
+    detail::spin_lock _shmLock;
+    shm::segment      _shm;
+    shm_map           _shmMap;
+
+    int64_t _begin;
+
+    // allocations made outside of any scope
+    std::atomic<int64_t> _allocCnt;
+    std::atomic<int64_t> _allocBytes;
+    std::atomic<int64_t> _freeCnt;
+
+    unsigned int _option;
+
+    int _perfKind;
+
+    std::atomic<int64_t> _budget;
+    slow_log             _slowest;
+
+    bool _enabled;
+    // forked from the process that created the profiler
+    bool _forked;
+
+    std::string _file;
+  };
+
+  namespace detail {
+    // a relaxed load and store, each block has a single writer
+    inline void count_thread(int idx, int64_t n) {
+      if (idx < 0) {
+        return;
+      }
+      tls_ctx& t = tls();
+      counter_block* b = t.counters;
+      if (UNLIKELY(!b)) {
+        alloc_mute mute;
+        b = new counter_block;
+        for (size_t i = 0; i < EZPP_COUNTER_MAX; ++i) {
+          b->values[i] = 0;
+        }
+        ezpp& pp = inst();
+        b->next = pp._counterBlocks;
+        while (!pp._counterBlocks.compare_exchange_strong(b->next, b));
+        t.counters = b;
+      }
+      std::atomic<int64_t>& v = b->values[idx];
+      v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // kept in the frame of the innermost scope and added to its node on leave
+    inline void count_scope(int idx, int64_t n) {
+      if (idx < 0) {
+        return;
+      }
+      exec_ctx& ctx = exec(tls());
+      if (!ctx.depth) {
+        count_thread(idx, n);
+        return;
+      }
+      frame& f = ctx.stack[ctx.depth - 1];
+      unsigned bit = 1u << idx;
+      if (f.counterMask & bit) {
+        f.counters[idx] += n;
+      }
+      else {
+        f.counters[idx] = n;
+        f.counterMask |= bit;
+      }
+    }
+
+    // a store to the thread's own slot, ordered by ezpp::heavyBarrier on the reclaiming side
+    inline epoch_guard::epoch_guard() : _t(tls()) {
+      if (_t.guardDepth++) {
+        return;
+      }
+      ezpp& pp = inst();
+      epoch_slot* slot = _t.slot;
+      if (UNLIKELY(!slot)) {
+        alloc_mute mute;
+        slot = new epoch_slot;
+        slot->active = 0;
+        slot->next = pp._slots;
+        while (!pp._slots.compare_exchange_strong(slot->next, slot));
+        _t.slot = slot;
+      }
+      slot->active.store(pp._gen.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      if (pp._membarrier) {
+        compiler_fence();
+      }
+      else {
+        full_fence();
+      }
+    }
+
+    inline epoch_guard::~epoch_guard() {
+      if (!--_t.guardDepth) {
+        _t.slot->active.store(0, std::memory_order_release);
+      }
+    }
+  }
+
+  // scoped lock of any Lockable, waits only hit the clock when try_lock fails
+  class lock_guard {
+  public:
+    template <typename M>
+    lock_guard(M& m, lock_site* site)
+      : _m(&m), _unlock(&unlock<M>), _site(site), _begin(0)
+    {
+      if (!_site) {
+        m.lock();
+      }
+      else if (m.try_lock()) {
+        _site->acquired();
+        _begin = time_now();
+      }
+      else {
+        int64_t wait = time_now();
+        m.lock();
+        _begin = time_now();
+        _site->acquired(_begin - wait);
+      }
+    }
+
+    ~lock_guard() {
+      if (_site) {
+        int64_t now = time_now();
+        _unlock(_m);
+        _site->released(now - _begin);
+      }
+      else {
+        _unlock(_m);
+      }
+    }
+
+  private:
+    lock_guard(const lock_guard&);
+    lock_guard& operator=(const lock_guard&);
+
+    template <typename M>
+    static void unlock(void* m) { static_cast<M*>(m)->unlock(); }
+
+    void*      _m;
+    void     (*_unlock)(void*);
+    lock_site* _site;
+    int64_t    _begin;
+  };
+
+  // drop-in wrapper of a mutex, instances constructed with the same name share one lock site
+  template <typename M>
+  class basic_mutex {
+  public:
+    explicit basic_mutex(const char* name = "ezpp::mutex") : _site(inst().lockSite(0, 0, name)), _begin(0) {}
+
+    void lock() {
+      if (!inst().enabled()) {
+        _m.lock();
+      }
+      else if (_m.try_lock()) {
+        _site->acquired();
+        _begin = time_now();
+      }
+      else {
+        int64_t wait = time_now();
+        _m.lock();
+        _begin = time_now();
+        _site->acquired(_begin - wait);
+      }
+    }
+
+    bool try_lock() {
+      if (!_m.try_lock()) {
+        return false;
+      }
+      if (inst().enabled()) {
+        _site->acquired();
+        _begin = time_now();
+      }
+      return true;
+    }
+
+    void unlock() {
+      int64_t begin = _begin;
+      _begin = 0;
+      if (begin) {
+        int64_t now = time_now();
+        _m.unlock();
+        _site->released(now - begin);
+      }
+      else {
+        _m.unlock();
+      }
+    }
+
+    inline M& native() { return _m; }
+
+  protected:
+    basic_mutex(const basic_mutex&);
+    basic_mutex& operator=(const basic_mutex&);
+
+    M          _m;
+    lock_site* _site;
+    int64_t    _begin; // only written by the exclusive owner
+  };
+
+  // shared holders are counted and their waits recorded, hold time is for exclusive owners only
+  template <typename M>
+  class basic_shared_mutex : public basic_mutex<M> {
+  public:
+    explicit basic_shared_mutex(const char* name = "ezpp::shared_mutex") : basic_mutex<M>(name) {}
+
+    void lock_shared() {
+      if (!inst().enabled()) {
+        this->_m.lock_shared();
+      }
+      else if (this->_m.try_lock_shared()) {
+        this->_site->acquired();
+      }
+      else {
+        int64_t wait = time_now();
+        this->_m.lock_shared();
+        this->_site->acquired(time_now() - wait);
+      }
+    }
+
+    bool try_lock_shared() {
+      if (!this->_m.try_lock_shared()) {
+        return false;
+      }
+      if (inst().enabled()) {
+        this->_site->acquired();
+      }
+      return true;
+    }
+
+    void unlock_shared() {
+      this->_m.unlock_shared();
+    }
+  };
+
+#if __cplusplus >= 201103L || _MSC_VER >= 1700
+  typedef basic_mutex<std::mutex> mutex;
+#endif
+#if __cplusplus >= 201703L || _MSVC_LANG >= 201703L
+  typedef basic_shared_mutex<std::shared_mutex> shared_mutex;
+#endif
+
+  // read-only views of the live figures for reporters, see ezpp::report. nothing is copied or
+  // formatted up front, values are read when asked for and keep moving while scopes run. a view
+  // and what it hands out are valid until the next clear()
+
+  // a folly map seen through V, which is constructed from each key / value pair
+  template <typename M, typename V>
+  class map_range {
+  public:
+    class iterator {
+    public:
+      explicit iterator(const typename M::const_iterator& it) : _it(it) {}
+
+      inline V operator*() const                          { return V(*_it); }
+      inline iterator& operator++()                       { ++_it; return *this; }
+      inline bool operator==(const iterator& rhs) const   { return _it == rhs._it; }
+      inline bool operator!=(const iterator& rhs) const   { return _it != rhs._it; }
+
+    private:
+      typename M::const_iterator _it;
+    };
+
+    explicit map_range(const M& m) : _m(m) {}
+
+    inline iterator begin() const          { return iterator(_m.cbegin()); }
+    inline iterator end() const            { return iterator(_m.cend()); }
+    inline bool empty() const              { return _m.cbegin() == _m.cend(); }
+
+  private:
+    const M& _m;
+  };
+
+  // time of a site per thread, per context or per object for classes
+  struct thread_cost {
+    size_t  key;
+    int64_t cost;
+
+    template <typename P>
+    explicit thread_cost(const P& p) : key(p.first), cost(p.second.data) {}
+  };
+
+  // calls of a site while one of site parent was open, see profile::edge
+  struct caller_cost {
+    size_t  parent;
+    int64_t callCnt;
+    int64_t totalCost;
+
+    template <typename P>
+    explicit caller_cost(const P& p) : parent(p.first), callCnt(p.second.callCnt), totalCost(p.second.totalCost) {}
+  };
+
+  class EZPP_API site_view {
+  public:
+    typedef map_range<node::time_map, thread_cost> thread_range;
+    typedef map_range<node::edge_map, caller_cost> caller_range;
+
+    explicit site_view(const node* n) : _n(n) {}
+    explicit site_view(const std::pair<size_t, folly::MutableData<node*> >& p) : _n(p.second.data) {}
+
+    inline size_t id() const               { return _n->_id; }
+    inline const char* file() const        { return _n->_file ? _n->_file : ""; }
+    inline int line() const                { return _n->_line; }
+    inline int endLine() const             { return _n->_endLine; }
+    inline const std::string& name() const { return _n->_name; }
+    inline const std::string& ext() const  { return _n->_ext; }
+    // EZPP_NODE_*
+    inline unsigned char flags() const     { return _n->_flags; }
+    // objects of a class aggregated instead of one key each, see objects()
+    inline bool aggregated() const         { return _n->aggregated(); }
+    inline int64_t created() const         { return _n->_created; }
+
+    // scopes still open and since when the first of them is
+    inline int64_t openCnt() const         { return _n->_totalRefCnt; }
+    inline int64_t openSince() const       { return _n->_start; }
+
+    inline int64_t callCnt() const         { return _n->_callCnt; }
+    inline int64_t totalCost() const       { return _n->_totalCost; }
+    inline int64_t selfCost() const        { return _n->_selfCost; }
+    inline int64_t childCost() const       { return _n->_childCost; }
+    inline int64_t queueCost() const       { return _n->_queueCost; }
+    inline int64_t suspendCost() const     { return _n->_suspendCost; }
+    inline const histogram& duration() const { return _n->_duration; }
+    inline void recent(int seconds, window::stat& out, int64_t now = time_now()) const { _n->recent(seconds, out, now); }
+
+    inline int64_t budget() const          { return _n->_budget; }
+    inline int64_t overCnt() const         { return _n->_overCnt; }
+    std::vector<slow_log::entry> slowest() const;
+
+    inline int64_t allocCnt() const        { return _n->_allocCnt; }
+    inline int64_t allocBytes() const      { return _n->_allocBytes; }
+    inline int64_t freeCnt() const         { return _n->_freeCnt; }
+    // EZPP_ADD total by counter id, see view::counterName
+    inline int64_t counter(int i) const    { return _n->_counters[i]; }
+
+    inline int64_t cpuCnt() const          { return _n->_cpuCnt; }
+    inline int64_t cpuCost() const         { return _n->_cpuCost; }
+    inline int64_t cpuWall() const         { return _n->_cpuWall; }
+    // EZPP_PERF_*, values in the order listed there
+    inline int perfKind() const            { return _n->_perfKind; }
+    inline int64_t perfCnt() const         { return _n->_perfCnt; }
+    inline int64_t perf(int i) const       { return _n->_perf[i]; }
+    // voluntary and involuntary context switches, minor and major faults
+    inline int64_t ruCnt() const           { return _n->_ruCnt; }
+    inline int64_t rusage(int i) const     { return _n->_ru[i]; }
+    // the same of one thread, false if not measured there
+    bool rusage(size_t key, int64_t values[EZPP_RUSAGE_MAX]) const;
+
+    inline const obj_tracker& objects() const { return _n->_objs; }
+    inline thread_range threads() const    { return thread_range(_n->_costMap); }
+    caller_range callers() const;
+    // SIGPROF samples taken inside, and the functions they hit by samples desc
+    int64_t samples(std::vector<sampled_func>& funcs) const;
+
+  protected:
+    const node* _n;
+  };
+
+  class EZPP_API view {
+  public:
+    typedef map_range<ezpp::node_map, site_view> site_range;
+
+    // taken under a detail::epoch_guard, see ezpp::report
+    explicit view(ezpp& pp) : _pp(pp), _now(time_now()) {}
+
+    inline site_range sites() const        { return site_range(*_pp._nodeMap.load(std::memory_order_acquire)); }
+    // when the view was taken, and the time since start or clear()
+    inline int64_t now() const             { return _now; }
+    inline int64_t elapsed() const         { return _now - _pp._begin; }
+    inline unsigned int options() const    { return _pp._option; }
+
+    // allocations made outside of any scope
+    inline int64_t allocCnt() const        { return _pp._allocCnt; }
+    inline int64_t allocBytes() const      { return _pp._allocBytes; }
+    inline int64_t freeCnt() const         { return _pp._freeCnt; }
+
+    // names of EZPP_COUNT and EZPP_ADD by id and process wide totals
+    inline int counterCnt() const          { return _pp._counterCnt; }
+    inline const std::string& counterName(int i) const { return _pp._counterNames[i]; }
+    inline int64_t counter(int i) const    { return _pp.counterTotal(i); }
+
+    // lock sites acquired at least once, by wait time desc
+    std::vector<lock_site*> locks() const;
+    // slowest calls over budget of all sites
+    inline std::vector<slow_log::entry> slowest() const { return _pp._slowest.top(); }
+    // description of a site id, e.g. of a caller or a scope in a slow call, 0 if unknown
+    inline const site* findSite(size_t id) const { return _pp.findSite(id); }
+
+  protected:
+    ezpp&   _pp;
+    int64_t _now;
+  };
+
+  // receives the figures on ezpp::report, e.g. to push them into a metrics library
+  class EZPP_API reporter {
+  public:
+    virtual ~reporter() {}
+    virtual void report(const view& v) = 0;
+  };
+
+  // the report of print() and save()
+  class EZPP_API text_reporter : public reporter {
+  public:
+    explicit text_reporter(FILE* fp) : _fp(fp) {}
+
+    virtual void report(const view& v);
+
+    // one site, what scopes of EZPP_DO print when they end
+    static void output(FILE* fp, const site_view& s);
+
+  protected:
+    static void outputKey(FILE* fp, const site_view& s, size_t key);
+    // context switches and faults of a thread or context, nothing unless EZPP_OPT_RUSAGE
+    static void outputRusage(FILE* fp, const site_view& s, size_t key);
+    static void outputSlow(FILE* fp, const slow_log::entry& e, bool named);
+    static void outputSites(FILE* fp, std::vector<site_view>& sites, bool (*sort)(const site_view&, const site_view&), const char* title);
+    static void outputLocks(FILE* fp, const view& v);
+    static void outputCounters(FILE* fp, const view& v);
+
+    FILE* _fp;
+  };
+
+  // one json object of the sites with their threads, callers and latencies, and the counters
+  class EZPP_API json_reporter : public reporter {
+  public:
+    explicit json_reporter(FILE* fp) : _fp(fp) {}
+
+    virtual void report(const view& v);
+
+  protected:
+    static void outputString(FILE* fp, const std::string& s);
+
+    FILE* _fp;
+  };
+
+#ifdef _EZPP_DEFINITIONS
+
+  EZPP_INLINE ezpp& inst() {
+    static ezpp inst(ezpp::init());
+    return inst;
+  }
+
+  namespace detail {
+    static bool NameSort(const site_view& lhs, const site_view& rhs) {
+      return lhs.name() < rhs.name();
+    }
+
+    static bool CallCntSort(const site_view& lhs, const site_view& rhs) {
+      return lhs.callCnt() < rhs.callCnt();
+    }
+
+    static bool CostTimeSort(const site_view& lhs, const site_view& rhs) {
+      return lhs.totalCost() < rhs.totalCost();
+    }
+
+    static bool WaitTimeSort(lock_site* lhs, lock_site* rhs) {
+      return lhs->waitTime() > rhs->waitTime();
+    }
+
+    static bool SampledSort(const sampled_func& lhs, const sampled_func& rhs) {
+      return lhs.cnt > rhs.cnt;
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::outputTime(FILE* fp, int64_t duration) {
+    // histogram buckets start at a microsecond, milliseconds would round them to 0.00
+    if (duration < 1000) {
+      fprintf(fp, "%" PRId64 " us", duration);
+      return;
+    }
+    double seconds = (double)duration / 1000000;
+    double minute = seconds / 60;
+    double hour = minute / 60;
+
+    if ((int)hour > 0) {
+      fprintf(fp, "%.0f hour%s, ", hour, hour > 1 ? "s" : "");
+    }
+
+    minute = (double)((int64_t)minute % 60);
+    if ((int)minute > 0) {
+      fprintf(fp, "%.0f min%s, ", minute, minute > 1 ? "s" : "");
+    }
+
+    seconds -= (double)(duration / 60000000 * 60);
+    if (seconds < 1) {
+      fprintf(fp, "%2.2f ms", seconds * 1000);
+    }
+    else {
+      fprintf(fp, "%2.2f sec%s", seconds, seconds > 1 ? "s" : "");
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::outputBytes(FILE* fp, int64_t bytes) {
+    if (bytes < 1024) {
+      fprintf(fp, "%" PRId64 " B", bytes);
+    }
+    else if (bytes < 1024 * 1024) {
+      fprintf(fp, "%.2f KB", (double)bytes / 1024);
+    }
+    else if (bytes < 1024 * 1024 * 1024) {
+      fprintf(fp, "%.2f MB", (double)bytes / (1024 * 1024));
+    }
+    else {
+      fprintf(fp, "%.2f GB", (double)bytes / (1024 * 1024 * 1024));
+    }
+  }
+
+  // protected static
+  EZPP_INLINE void
+  ezpp::outputCount(FILE* fp, double cnt) {
+    static const char* units[] = { "", " K", " M", " G", " T" };
+    size_t unit = 0;
+    while (cnt >= 1000 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+      cnt /= 1000;
+      ++unit;
+    }
+    fprintf(fp, unit ? "%.2f%s" : "%.0f%s", cnt, units[unit]);
+  }
+
+  // protected
+  EZPP_INLINE int64_t
+  ezpp::counterTotal(int i) {
+    int64_t total = 0;
+    for (detail::counter_block* b = _counterBlocks; b; b = b->next) {
+      total += b->values[i].load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  // protected
+  EZPP_INLINE const site*
+  ezpp::findSite(size_t id) {
+    detail::spin_guard guard(_filterLock);
+    for (const site* s = _sites; s; s = s->_next) {
+      if (s->_id == id) {
+        return s;
+      }
+    }
+    return 0;
+  }
+
+  // protected
+  EZPP_INLINE ezpp::ezpp(int/* dummy */)
+    : _doMap(new node_map(EZPP_NODE_MAX + EZPP_FN_MAX))
+    , _nodeMap(new node_map(EZPP_NODE_MAX + EZPP_FN_MAX))
+    , _retired()
+    , _gen(1)
+    , _slots(0)
+    , _membarrier(false)
+    , _resetAt(0)
+    , _fnSites(EZPP_FN_MAX)
+    , _fnCnt(0)
+    , _instrEvery(1)
+    , _sites(0)
+    , _counterCnt(0)
+    , _counterBlocks(0)
+    , _begin(0)
+    , _allocCnt(0)
+    , _allocBytes(0)
+    , _freeCnt(0)
+    , _option(0)
+    , _perfKind(EZPP_PERF_NONE)
+    , _budget(0)
+    , _enabled(false)
+    , _forked(false)
+    , _file()
+  {
+  #ifndef _WIN32
+    _dumpPipe[0] = _dumpPipe[1] = -1;
+    _dumpSignals = _dumpResets = 0;
+    _dumpSeq = 0;
+  #endif
+  #ifdef __linux__
+    _sampleHz = 0;
+    _sampleInit = false;
+    memset(&_samplePrev, 0, sizeof(_samplePrev));
+    _sampleBlocks = 0;
+    _sampleDropped = 0;
+  #endif
+    const char* rules = getenv("EZPP_FILTER");
+    if (rules) {
+      setFilter(rules);
+    }
+    const char* file = getenv("EZPP_FILTER_FILE");
+    if (file) {
+      loadFilter(file);
+    }
+    if (getenv("EZPP_SHM")) {
+      addOption(EZPP_OPT_SHM);
+    }
+  #ifndef _WIN32
+    pthread_atfork(forkPrepare, forkParent, forkChild);
+    const char* sig = getenv("EZPP_DUMP_SIGNAL");
+    if (sig) {
+      int signo = !strcmp(sig, "USR1") ? SIGUSR1 : !strcmp(sig, "USR2") ? SIGUSR2 : atoi(sig);
+      if (signo > 0) {
+        dumpOnSignal(signo, getenv("EZPP_DUMP_RESET") != 0);
+      }
+    }
+  #endif
+    const char* hz = getenv("EZPP_SAMPLE");
+    if (hz) {
+      setSampling(atoi(hz));
+    }
+    const char* every = getenv("EZPP_INSTRUMENT_SAMPLE");
+    if (every) {
+      setInstrumentSampling(atoi(every));
+    }
+    --detail::instr_off();
+  #if defined(__linux__) && defined(__NR_membarrier)
+    _membarrier = !syscall(__NR_membarrier, _EZPP_MEMBARRIER_REGISTER, 0);
+  #endif
+  }
+
+  // protected
+  EZPP_INLINE ezpp::~ezpp() {
+    // instrumented code running during exit isn't recorded any more
+    _instrEvery = 0;
+  #ifndef _WIN32
+    stopDump();
+  #endif
+    print();
+    if (_enabled && (_option & EZPP_OPT_SAVE_IN_DTOR)) {
+      save();
+    }
+    const char* prof = getenv("EZPP_PROFILE");
+    if (_enabled && prof) {
+      saveProfile(prof);
+    }
+    clear();
+    for (lock_map::iterator it = _lockMap.begin(); it != _lockMap.end(); ++it) {
+      delete it->second;
+    }
+  }
+
+  // public static
+  EZPP_INLINE node*
+  ezpp::create(const site& s, size_t c12n, unsigned char flags) {
+    if (!inst().enabled() || !flags) {
+      return 0;
+    }
+    if ((flags & EZPP_NODE_CLS) && (inst()._option & EZPP_OPT_CLS_DETAIL)) {
+      flags |= EZPP_NODE_CLS_DETAIL;
+    }
+    detail::epoch_guard guard;
+    std::atomic<node_map*>& cur = (flags & EZPP_NODE_DIRECT_OUTPUT) ? inst()._doMap : inst()._nodeMap;
+    node_map* found;
+    // clear() may drop a found node to its last reference before we take ours, look again then
+    for (;;) {
+      found = cur.load(std::memory_order_acquire);
+      node_map::const_iterator it = found->find(s.id());
+      if (it == found->cend()) {
+        break;
+      }
+      if ((flags & EZPP_NODE_SPAN) || it->second.data->call(c12n)) {
+        return it->second.data;
+      }
+    }
+    node_map& map = *found;
+    detail::alloc_mute mute;
+    node* n = new node(s.id(), c12n, flags);
+    n->setDesc(s.file(), s.line(), s.name(), s.ext());
+    if (inst()._option & EZPP_OPT_SHM) {
+      n->_shm = inst().shmRecord(s);
+    }
+    // lost the race for the site to another thread, or the map was swapped by clear() meanwhile,
+    // the node ends with its scope
+    if (!map.insert(s.id(), n).second || cur.load(std::memory_order_acquire) != &map) {
+      release(node_map::value_type(s.id(), folly::MutableData<node*>(n)));
+    }
+    return n;
+  }
+
+  // public static
+  EZPP_INLINE void
+  ezpp::release(const std::pair<size_t, folly::MutableData<node*> >& node_pair) {
+    // a reference of our own, so that exactly one of us and the scopes still open drops the last
+    node* n = node_pair.second.data;
+    ++n->_totalRefCnt;
+    n->setReleaseUntilEnd();
+    if (!--n->_totalRefCnt) {
+      n->retire();
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::retire(void* p, void (*del)(void*)) {
+    detail::alloc_mute mute;
+    retired r;
+    r.p = p;
+    r.del = del;
+    r.gen = _gen++;
+    size_t cnt;
+    {
+      detail::spin_guard guard(_retireLock);
+      _retired.push_back(r);
+      cnt = _retired.size();
+    }
+    if (cnt >= EZPP_RETIRE_BATCH) {
+      reclaim(false);
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::reclaim(bool wait) {
+    detail::alloc_mute mute;
+    // a thread can't wait for the guard it is in itself
+    if (detail::tls().guardDepth) {
+      wait = false;
+    }
+    for (;;) {
+      heavyBarrier();
+      int64_t oldest = -1;
+      for (detail::epoch_slot* slot = _slots; slot; slot = slot->next) {
+        int64_t gen = slot->active.load(std::memory_order_acquire);
+        if (gen && (oldest < 0 || gen < oldest)) {
+          oldest = gen;
+        }
+      }
+      std::vector<retired> ready;
+      bool left;
+      {
+        detail::spin_guard guard(_retireLock);
+        size_t kept = 0;
+        for (size_t i = 0; i < _retired.size(); ++i) {
+          if (oldest < 0 || _retired[i].gen < oldest) {
+            ready.push_back(_retired[i]);
+          }
+          else {
+            _retired[kept++] = _retired[i];
+          }
+        }
+        _retired.resize(kept);
+        left = kept > 0;
+      }
+      for (size_t i = 0; i < ready.size(); ++i) {
+        ready[i].del(ready[i].p);
+      }
+      if (!wait || !left) {
+        break;
+      }
+    #ifdef _WIN32
+      Sleep(0);
+    #else
+      sched_yield();
+    #endif
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::heavyBarrier() {
+  #if defined(__linux__) && defined(__NR_membarrier)
+    if (_membarrier && !syscall(__NR_membarrier, _EZPP_MEMBARRIER_PRIVATE_EXPEDITED, 0)) {
+      return;
+    }
+  #endif
+    detail::full_fence();
+  }
+
+  // protected static
+  EZPP_INLINE void
+  ezpp::deleteNode(void* p) {
+    delete (node*)p;
+  }
+
+  // protected static
+  EZPP_INLINE void
+  ezpp::deleteMap(void* p) {
+    delete (node_map*)p;
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::output(FILE* fp) {
+    text_reporter r(fp);
+    report(r);
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::report(reporter& r) {
+    detail::alloc_mute mute;
+    detail::exec_ctx& ctx = detail::exec(detail::tls());
+    if (!ctx.depth) {
+      chargeUnscoped(ctx.allocCnt, ctx.allocBytes, ctx.freeCnt);
+      ctx.allocCnt = ctx.allocBytes = ctx.freeCnt = 0;
+    }
+    detail::epoch_guard guard;
+    view v(*this);
+    r.report(v);
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::setFilter(const std::string& rules) {
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_filterLock);
+    _filter.clear();
+    size_t begin = 0;
+    while (begin <= rules.size()) {
+      size_t end = rules.find_first_of(";\r\n", begin);
+      if (end == std::string::npos) {
+        end = rules.size();
+      }
+      _filter.add(rules.substr(begin, end - begin));
+      begin = end + 1;
+    }
+    applyFilter();
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::addFilter(const std::string& rule) {
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_filterLock);
+    if (_filter.add(rule)) {
+      applyFilter();
+    }
+  }
+
+  // public
+  EZPP_INLINE bool
+  ezpp::loadFilter(const std::string& file) {
+    FILE* fp = fopen(file.c_str(), "rb");
+    if (!fp) {
+      return false;
+    }
+    std::string rules;
+    char buf[256];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+      rules.append(buf, len);
+    }
+    fclose(fp);
+    setFilter(rules);
+    return true;
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::clearFilter() {
+    detail::spin_guard guard(_filterLock);
+    _filter.clear();
+    applyFilter();
+  }
+
+  // protected, with _filterLock held
+  EZPP_INLINE void
+  ezpp::applyFilter() {
+    for (site* s = _sites; s; s = s->_next) {
+      s->_enabled = _filter.match(*s);
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::registerSite(site* s) {
+    detail::spin_guard guard(_filterLock);
+    // a site compiled into several translation units registers once per copy under one id
+    site* it = _sites;
+    while (it) {
+      if (it->_id == s->_id && !it->same(*s)) {
+        fprintf(stderr, "ezpp: site id collision between %s (%s:%d) and %s (%s:%d)\r\n",
+          it->_name.c_str(), it->_file, it->_line, s->_name.c_str(), s->_file, s->_line);
+        s->_id = (size_t)((s->_id ^ EZPP_FNV_BASIS) * EZPP_FNV_PRIME);
+        it = _sites;
+      }
+      else {
+        it = it->_next;
+      }
+    }
+    s->_enabled = _filter.match(*s);
+    s->_next = _sites;
+    _sites = s;
+  }
+
+  EZPP_INLINE site::site(unsigned long long hash, const char* file, int line, const std::string& name, const std::string& ext)
+    : _id(0), _file(file), _line(line), _name(name), _ext(ext), _enabled(0), _next(0)
+  {
+    unsigned long long h = detail::fnv1a(ext.c_str(), detail::fnv1a(0u, detail::fnv1a(name.c_str(), hash), 1));
+    _id = sizeof(size_t) < sizeof(h) ? (size_t)(h ^ (h >> 32)) : (size_t)h;
+    if (!_id) {
+      _id = 1;
+    }
+    inst().registerSite(this);
+  }
+
+  // public
+  EZPP_INLINE bool
+  site::same(const site& s) const {
+    return _line == s._line && _name == s._name && _ext == s._ext
+      && !strcmp(detail::file_name(_file, _file), detail::file_name(s._file, s._file));
+  }
+
+  EZPP_INLINE context::context()
+    : _prev(0)
+    , _leftAt(0)
+  {
+    static std::atomic<size_t> lastId(0);
+    memset(&_exec, 0, sizeof(_exec));
+    _exec.id = EZPP_CONTEXT_TAG | ++lastId;
+  }
+
+  // public
+  EZPP_INLINE void
+  context::enter() {
+    detail::tls_ctx& t = detail::tls();
+    _prev = t.cur;
+    t.cur = &_exec;
+    if (_leftAt) {
+      _exec.suspended += time_now() - _leftAt;
+      _leftAt = 0;
+    }
+  }
+
+  // public
+  EZPP_INLINE void
+  context::leave() {
+    detail::tls_ctx& t = detail::tls();
+    if (t.cur != &_exec) {
+      return;
+    }
+    // clocks and counters of calling thread don't apply where the context is resumed
+    for (int i = 0; i < _exec.depth; ++i) {
+      _exec.stack[i].cpu = _exec.stack[i].perf = _exec.stack[i].ru = false;
+    }
+    t.cur = _prev;
+    _prev = 0;
+    _leftAt = time_now();
+  }
+
+  // public
+  EZPP_INLINE void
+  span::start(node* n) {
+    end();
+    if (n) {
+      _begin = n->spanBegin();
+      _mark = 0;
+      _n = n;
+    }
+  }
+
+  // public
+  EZPP_INLINE void
+  span::mark() {
+    if (_n) {
+      _mark = time_now();
+    }
+  }
+
+  // public
+  EZPP_INLINE void
+  span::end() {
+    if (_n) {
+      node* n = _n;
+      _n = 0;
+      n->spanEnd(_begin, _mark ? _mark - _begin : 0);
+    }
+  }
+
+  // public
+  EZPP_INLINE bool
+  site_filter::add(const std::string& spec) {
+    size_t begin = spec.find_first_not_of(" \t");
+    size_t end = spec.find_last_not_of(" \t");
+    if (begin == std::string::npos || spec[begin] == '#') {
+      return false;
+    }
+    rule r;
+    r.include = spec[begin] != '-';
+    if (spec[begin] == '+' || spec[begin] == '-') {
+      ++begin;
+    }
+    r.field = 0;
+    static const char* fields[] = { "file:", "name:", "ext:" };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+      if (!spec.compare(begin, strlen(fields[i]), fields[i])) {
+        r.field = fields[i][0];
+        begin += strlen(fields[i]);
+        break;
+      }
+    }
+    if (begin > end) {
+      return false;
+    }
+    r.pattern = spec.substr(begin, end - begin + 1);
+    _rules.push_back(r);
+    return true;
+  }
+
+  // public
+  EZPP_INLINE bool
+  site_filter::match(const site& s) const {
+    bool hasInclude = false;
+    for (size_t i = 0; i < _rules.size(); ++i) {
+      const rule& r = _rules[i];
+      if (((!r.field || r.field == 'f') && glob(r.pattern.c_str(), s.file()))
+        || ((!r.field || r.field == 'n') && glob(r.pattern.c_str(), s.name().c_str()))
+        || ((!r.field || r.field == 'e') && glob(r.pattern.c_str(), s.ext().c_str()))) {
+        return r.include;
+      }
+      hasInclude |= r.include;
+    }
+    return !hasInclude;
+  }
+
+  // public static, '*' for any sequence and '?' for any single char
+  EZPP_INLINE bool
+  site_filter::glob(const char* pattern, const char* str) {
+    const char* star = 0;
+    const char* retry = 0;
+    while (*str) {
+      if (*pattern == '*') {
+        star = pattern++;
+        retry = str;
+      }
+      else if (*pattern == '?' || *pattern == *str) {
+        ++pattern;
+        ++str;
+      }
+      else if (star) {
+        pattern = star + 1;
+        str = ++retry;
+      }
+      else {
+        return false;
+      }
+    }
+    while (*pattern == '*') {
+      ++pattern;
+    }
+    return !*pattern;
+  }
+
+  // public
+  EZPP_INLINE int
+  ezpp::counterId(const char* name) {
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_counterLock);
+    int cnt = _counterCnt;
+    for (int i = 0; i < cnt; ++i) {
+      if (_counterNames[i] == name) {
+        return i;
+      }
+    }
+    if (cnt == EZPP_COUNTER_MAX) {
+      fprintf(stderr, "ezpp: counter \"%s\" ignored, EZPP_COUNTER_MAX names in use\r\n", name);
+      return -1;
+    }
+    _counterNames[cnt] = name;
+    _counterCnt = cnt + 1;
+    return cnt;
+  }
+
+  // public
+  EZPP_INLINE int64_t
+  ezpp::counter(const std::string& name) {
+    int64_t total = 0;
+    for (int i = 0; i < _counterCnt; ++i) {
+      if (_counterNames[i] == name) {
+        total += counterTotal(i);
+      }
+    }
+    return total;
+  }
+
+  // public
+  EZPP_INLINE lock_site*
+  ezpp::lockSite(const char* file, int line, const std::string& name, const std::string& ext/* = ""*/) {
+    char pos[32];
+    sprintf(pos, ":%d:", line);
+    std::string key = (file ? file : "") + std::string(pos) + name + '\n' + ext;
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_lockLock);
+    lock_site*& site = _lockMap[key];
+    if (!site) {
+      site = new lock_site(file, line, name, ext);
+    }
+    return site;
+  }
+
+  // protected
+  EZPP_INLINE shm::record*
+  ezpp::shmRecord(const site& s) {
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_shmLock);
+    shm::record*& r = _shmMap[s.id()];
+    if (!r) {
+      r = _shm.alloc(s.id(), s.file(), s.line(), s.name(), s.ext());
+    }
+    return r;
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::print() {
+    output(stdout);
+  }
+
+  // protected static
+  EZPP_INLINE std::string
+  ezpp::expandName(const std::string& file) {
+    std::string r;
+    for (size_t i = 0; i < file.size(); ++i) {
+      if (file[i] != '%' || i + 1 == file.size()) {
+        r += file[i];
+        continue;
+      }
+      char c = file[++i];
+      if (c == 'p') {
+        char buf[32];
+      #ifdef _WIN32
+        sprintf(buf, "%u", (unsigned)GetCurrentProcessId());
+      #else
+        sprintf(buf, "%d", (int)getpid());
+      #endif
+        r += buf;
+      }
+      else if (c == 'h') {
+        char host[256] = "";
+      #ifdef _WIN32
+        DWORD len = sizeof(host);
+        GetComputerNameA(host, &len);
+      #else
+        gethostname(host, sizeof(host) - 1);
+      #endif
+        r += host;
+      }
+      else {
+        if (c != '%') {
+          r += '%';
+        }
+        r += c;
+      }
+    }
+    return r;
+  }
+
+  // public, forked children don't share the default name with their parent
+  EZPP_INLINE std::string
+  ezpp::getOutputFileName() {
+    return expandName(_file.empty() ? (_forked ? "ezpp.%p.log" : "ezpp.log") : _file);
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::save(const std::string& file/* = ""*/) {
+    FILE* fp = fopen(file.empty() ? getOutputFileName().c_str() : expandName(file).c_str(), "wb+");
+    if(!fp) return;
+    output(fp);
+    fclose(fp);
+  }
+
+  // public
+  EZPP_INLINE bool
+  ezpp::dumpOnSignal(int signo, bool reset/* = false*/) {
+  #ifdef _WIN32
+    (void)signo; (void)reset;
+    return false;
+  #else
+    if (signo <= 0 || signo >= 64) {
+      return false;
+    }
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_dumpLock);
+    if (_dumpPipe[0] < 0 && !startDump()) {
+      return false;
+    }
+    if (reset) {
+      _dumpResets |= (uint64_t)1 << signo;
+    }
+    else {
+      _dumpResets &= ~((uint64_t)1 << signo);
+    }
+    if (!(_dumpSignals & ((uint64_t)1 << signo))) {
+      struct sigaction sa;
+      memset(&sa, 0, sizeof(sa));
+      sa.sa_handler = onDumpSignal;
+      sa.sa_flags = SA_RESTART;
+      sigemptyset(&sa.sa_mask);
+      if (sigaction(signo, &sa, 0)) {
+        return false;
+      }
+      _dumpSignals |= (uint64_t)1 << signo;
+    }
+    return true;
+  #endif
+  }
+
+#ifndef _WIN32
+  // protected static, async-signal-safe, a full pipe drops the request
+  EZPP_INLINE void
+  ezpp::onDumpSignal(int signo) {
+    int saved = errno;
+    char c = (char)signo;
+    if (write(inst()._dumpPipe[1], &c, 1) < 0) {
+      // dropped
+    }
+    errno = saved;
+  }
+
+  // protected static
+  EZPP_INLINE void*
+  ezpp::dumpLoop(void*) {
+    // signals go to the threads doing the work, not to the one reporting on them
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, 0);
+    ezpp& pp = inst();
+    for (;;) {
+      char c;
+      ssize_t r = read(pp._dumpPipe[0], &c, 1);
+      if (r < 0 && errno == EINTR) {
+        continue;
+      }
+      // 0 is sent by stopDump
+      if (r <= 0 || !c) {
+        break;
+      }
+      pp.dump((unsigned char)c);
+    }
+    return 0;
+  }
+
+  // protected, under _dumpLock
+  EZPP_INLINE bool
+  ezpp::startDump() {
+    if (pipe(_dumpPipe)) {
+      _dumpPipe[0] = _dumpPipe[1] = -1;
+      return false;
+    }
+    fcntl(_dumpPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(_dumpPipe[1], F_SETFD, FD_CLOEXEC);
+    fcntl(_dumpPipe[1], F_SETFL, fcntl(_dumpPipe[1], F_GETFL) | O_NONBLOCK);
+    if (pthread_create(&_dumpThread, 0, dumpLoop, 0)) {
+      close(_dumpPipe[0]);
+      close(_dumpPipe[1]);
+      _dumpPipe[0] = _dumpPipe[1] = -1;
+      return false;
+    }
+    return true;
+  }
+
+  // protected, the handlers stay, their writes fail once the pipe is closed
+  EZPP_INLINE void
+  ezpp::stopDump() {
+    if (_dumpPipe[0] < 0) {
+      return;
+    }
+    char c = 0;
+    int fd = _dumpPipe[1];
+    // the write end is non-blocking, a pipe full of requests is drained by the helper first
+    while (write(fd, &c, 1) < 0 && errno == EAGAIN) {
+      sched_yield();
+    }
+    pthread_join(_dumpThread, 0);
+    _dumpPipe[1] = -1;
+    close(fd);
+    close(_dumpPipe[0]);
+    _dumpPipe[0] = -1;
+  }
+
+  // protected, on the helper thread
+  EZPP_INLINE void
+  ezpp::dump(int signo) {
+    detail::alloc_mute mute;
+    char suffix[64];
+    {
+      detail::spin_guard guard(_dumpLock);
+      sprintf(suffix, ".%d.%d", (int)getpid(), ++_dumpSeq);
+    }
+    std::string file = getOutputFileName() + suffix;
+    FILE* fp = fopen(file.c_str(), "wb+");
+    if (fp) {
+      output(fp);
+      fclose(fp);
+    }
+    if (_dumpResets & ((uint64_t)1 << signo)) {
+      reset();
+    }
+  }
+#endif
+
+  namespace detail {
+    // the function pc is in, demangled, "module+offset" for addr2line if it isn't exported
+    EZPP_INLINE std::string symbol_name(void* pc, const char** module) {
+      std::string name;
+    #ifdef __linux__
+      Dl_info info;
+      if (pc && dladdr(pc, &info)) {
+        if (module) {
+          *module = info.dli_fname;
+        }
+        if (info.dli_sname) {
+          name = info.dli_sname;
+        #ifdef __GNUC__
+          int status = 0;
+          char* demangled = abi::__cxa_demangle(info.dli_sname, 0, 0, &status);
+          if (demangled) {
+            name = demangled;
+            free(demangled);
+          }
+        #endif
+        }
+        else if (info.dli_fname) {
+          const char* base = strrchr(info.dli_fname, '/');
+          char buf[64];
+          sprintf(buf, "+0x%llx", (unsigned long long)((char*)pc - (char*)info.dli_fbase));
+          name = std::string(base ? base + 1 : info.dli_fname) + buf;
+        }
+      }
+    #endif
+      if (name.empty()) {
+        char buf[32];
+        sprintf(buf, "%p", pc);
+        name = buf;
+      }
+      return name;
+    }
+  }
+
+  // public
+  EZPP_INLINE node*
+  ezpp::instrEnter(void* fn, uint32_t rnd) {
+    int every = _instrEvery.load(std::memory_order_relaxed);
+    if (!_enabled || every <= 0 || (every > 1 && rnd % (uint32_t)every)) {
+      return 0;
+    }
+    const site* s = fnSite(fn);
+    if (!s || !s->enabled()) {
+      return 0;
+    }
+    return create(*s, EZPP_THREAD_ID, EZPP_NODE_AUTO_START);
+  }
+
+  // protected, named once on the first call, filters need the name before the site is used
+  EZPP_INLINE const site*
+  ezpp::fnSite(void* fn) {
+    fn_map::const_iterator it = _fnSites.find((size_t)fn);
+    if (LIKELY(it != _fnSites.cend())) {
+      return it->second.data;
+    }
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_fnLock);
+    fn_map::const_iterator made = _fnSites.find((size_t)fn);
+    if (made != _fnSites.cend()) {
+      return made->second.data;
+    }
+    if (_fnCnt >= EZPP_FN_MAX) {
+      return 0;
+    }
+    const char* module = 0;
+    std::string name = detail::symbol_name(fn, &module);
+    // the id stays the same from run to run whatever address the module is loaded at: the module
+    // basename and the symbol, or its offset in the module when it has no symbol
+    site* s = new site(detail::site_hash(module ? module : "", 0), module ? module : "", 0, name, "");
+    _fnSites.insert((size_t)fn, s);
+    ++_fnCnt;
+    return s;
+  }
+
+  // public
+  EZPP_INLINE bool
+  ezpp::setSampling(int hz) {
+  #ifdef __linux__
+    detail::alloc_mute mute;
+    {
+      detail::spin_guard guard(_sampleLock);
+      if (!_sampleInit) {
+        if (pthread_key_create(&_sampleKey, releaseSamples)) {
+          return false;
+        }
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = onSample;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGPROF, &sa, &_samplePrev)) {
+          pthread_key_delete(_sampleKey);
+          return false;
+        }
+        _sampleInit = true;
+      }
+    }
+    _sampleHz = hz > 0 ? (hz < 1000000 ? hz : 1000000) : 0;
+    return true;
+  #else
+    (void)hz;
+    return false;
+  #endif
+  }
+
+#ifdef __linux__
+  // protected static, async-signal-safe, nothing but the thread's own block is written
+  EZPP_INLINE void
+  ezpp::onSample(int signo, siginfo_t* info, void* uc) {
+    int saved = errno;
+    detail::tls_ctx& t = detail::tls();
+    detail::sample_block* b = t.samples;
+    detail::exec_ctx& ctx = detail::exec(t);
+    // only our own timer, SIGPROF of other profilers goes to their handler alone
+    bool ours = info && info->si_code == SI_TIMER && b && info->si_value.sival_ptr == b;
+    if (ours && ctx.depth) {
+      uint32_t head = b->head.load(std::memory_order_relaxed);
+      if (head - b->tail.load(std::memory_order_acquire) >= EZPP_SAMPLE_BUF) {
+        ++b->dropped;
+      }
+      else {
+        detail::sample& s = b->slots[head & (EZPP_SAMPLE_BUF - 1)];
+        const mcontext_t& mc = ((ucontext_t*)uc)->uc_mcontext;
+      #if defined(__x86_64__)
+        s.pc = (void*)mc.gregs[REG_RIP];
+      #elif defined(__i386__)
+        s.pc = (void*)mc.gregs[REG_EIP];
+      #elif defined(__aarch64__)
+        s.pc = (void*)mc.pc;
+      #else
+        (void)mc;
+        s.pc = 0;
+      #endif
+        int n = 0;
+        for (int i = ctx.depth - 1; i >= 0 && n < EZPP_SAMPLE_SCOPES; --i) {
+          s.scopes[n++] = ctx.stack[i].n->_id;
+        }
+        s.depth = n;
+        b->head.store(head + 1, std::memory_order_release);
+      }
+    }
+    errno = saved;
+    if (ours) {
+      return;
+    }
+    const struct sigaction& prev = inst()._samplePrev;
+    if (prev.sa_flags & SA_SIGINFO) {
+      if (prev.sa_sigaction) {
+        prev.sa_sigaction(signo, info, uc);
+      }
+    }
+    else if (prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN) {
+      prev.sa_handler(signo);
+    }
+  }
+
+  // protected static
+  EZPP_INLINE void
+  ezpp::releaseSamples(void* p) {
+    detail::sample_block* b = (detail::sample_block*)p;
+    // the exiting thread takes no SIGPROF anymore, one still pending mustn't write into the block
+    // once the next thread has it
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &set, 0);
+    if (b->armed) {
+      timer_delete(b->timer);
+      b->armed = false;
+    }
+    detail::tls().samples = 0;
+    b->used.store(0, std::memory_order_release);
+  }
+
+  // protected, the timer counts the cpu time of the calling thread only
+  EZPP_INLINE void
+  ezpp::armSampling(detail::tls_ctx& t) {
+    detail::alloc_mute mute;
+    int hz = _sampleHz;
+    t.sampleHz = hz;
+    detail::sample_block* b = t.samples;
+    if (!b) {
+      if (!hz) {
+        return;
+      }
+      for (b = _sampleBlocks; b; b = b->next) {
+        int unused = 0;
+        if (b->used.compare_exchange_strong(unused, 1)) {
+          break;
+        }
+      }
+      if (!b) {
+        b = new detail::sample_block;
+        b->head = b->tail = 0;
+        b->dropped = 0;
+        b->used = 1;
+        b->armed = false;
+        b->next = _sampleBlocks;
+        while (!_sampleBlocks.compare_exchange_strong(b->next, b));
+      }
+      t.samples = b;
+      pthread_setspecific(_sampleKey, b);
+    }
+    if (!b->armed) {
+      if (!hz) {
+        return;
+      }
+      struct sigevent sev;
+      memset(&sev, 0, sizeof(sev));
+      sev.sigev_notify = SIGEV_THREAD_ID;
+      sev.sigev_signo = SIGPROF;
+      sev.sigev_value.sival_ptr = b;
+      sev.sigev_notify_thread_id = (pid_t)_EZPP_OS_THREAD_ID;
+      if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &b->timer)) {
+        return;
+      }
+      b->armed = true;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (hz) {
+      its.it_interval.tv_sec = 1 / hz;
+      its.it_interval.tv_nsec = hz > 1 ? 1000000000L / hz : 0;
+      its.it_value = its.it_interval;
+    }
+    timer_settime(b->timer, 0, &its, 0);
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::drainSamples(bool wait) {
+    if (wait) {
+      _sampleLock.lock();
+    }
+    else if (!_sampleLock.try_lock()) {
+      return;
+    }
+    detail::alloc_mute mute;
+    for (detail::sample_block* b = _sampleBlocks; b; b = b->next) {
+      uint32_t head = b->head.load(std::memory_order_acquire);
+      for (uint32_t tail = b->tail.load(std::memory_order_relaxed); tail != head; ++tail) {
+        const detail::sample& s = b->slots[tail & (EZPP_SAMPLE_BUF - 1)];
+        for (int i = 0; i < s.depth; ++i) {
+          // recursion counts once
+          bool seen = false;
+          for (int j = 0; j < i && !seen; ++j) {
+            seen = s.scopes[j] == s.scopes[i];
+          }
+          if (!seen) {
+            ++_samples[s.scopes[i]][s.pc];
+          }
+        }
+      }
+      b->tail.store(head, std::memory_order_release);
+      _sampleDropped += b->dropped.exchange(0);
+    }
+    _sampleLock.unlock();
+  }
+#endif
+
+  // protected, pcs are resolved to the functions they are in here, not in the handler
+  EZPP_INLINE int64_t
+  ezpp::sampled(size_t id, std::vector<sampled_func>& funcs) {
+    funcs.clear();
+  #ifdef __linux__
+    detail::alloc_mute mute;
+    drainSamples(true);
+    pc_map pcs;
+    {
+      detail::spin_guard guard(_sampleLock);
+      std::map<size_t, pc_map>::const_iterator it = _samples.find(id);
+      if (it == _samples.end()) {
+        return 0;
+      }
+      pcs = it->second;
+    }
+    int64_t total = 0;
+    std::map<std::string, int64_t> byName;
+    for (pc_map::const_iterator it = pcs.begin(); it != pcs.end(); ++it) {
+      total += it->second;
+      byName[detail::symbol_name(it->first, 0)] += it->second;
+    }
+    for (std::map<std::string, int64_t>::const_iterator it = byName.begin(); it != byName.end(); ++it) {
+      sampled_func f;
+      f.name = it->first;
+      f.cnt = it->second;
+      funcs.push_back(f);
+    }
+    std::sort(funcs.begin(), funcs.end(), detail::SampledSort);
+    return total;
+  #else
+    (void)id;
+    return 0;
+  #endif
+  }
+
+  // public
+  EZPP_INLINE profile
+  ezpp::snapshot() {
+    detail::alloc_mute mute;
+    detail::epoch_guard guard;
+    view v(*this);
+    profile p;
+    p.elapsed = v.elapsed();
+    view::site_range sites = v.sites();
+    for (view::site_range::iterator it = sites.begin(); it != sites.end(); ++it) {
+      site_view s = *it;
+      profile::entry e;
+      e.id = s.id();
+      e.file = s.file();
+      e.line = s.line();
+      e.name = s.name();
+      e.ext = s.ext();
+      e.callCnt = s.callCnt();
+      e.totalCost = s.totalCost();
+      e.selfCost = s.selfCost();
+      e.cpuCost = s.cpuCost();
+      e.allocCnt = s.allocCnt();
+      e.allocBytes = s.allocBytes();
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        e.duration[i] = s.duration().bucketCnt(i);
+      }
+      site_view::thread_range threads = s.threads();
+      for (site_view::thread_range::iterator tit = threads.begin(); tit != threads.end(); ++tit) {
+        thread_cost t = *tit;
+        e.threadCost[t.key] = t.cost;
+      }
+      p.entries.push_back(e);
+      site_view::caller_range callers = s.callers();
+      for (site_view::caller_range::iterator cit = callers.begin(); cit != callers.end(); ++cit) {
+        caller_cost c = *cit;
+        profile::edge ed;
+        ed.parent = c.parent;
+        ed.child = s.id();
+        ed.callCnt = c.callCnt;
+        ed.totalCost = c.totalCost;
+        p.edges.push_back(ed);
+      }
+    }
+    return p;
+  }
+
+  // public
+  EZPP_INLINE profile
+  ezpp::recent(int seconds) {
+    detail::alloc_mute mute;
+    detail::epoch_guard guard;
+    profile p;
+    int64_t now = time_now();
+    const node_map& map = *_nodeMap.load(std::memory_order_acquire);
+    for (node_map::const_iterator it = map.cbegin(); it != map.cend(); ++it) {
+      const node* n = it->second.data;
+      window::stat st;
+      n->recent(seconds, st, now);
+      p.elapsed = st.span;
+      if (!st.callCnt) {
+        continue;
+      }
+      profile::entry e;
+      e.id = n->_id;
+      e.file = n->_file ? n->_file : "";
+      e.line = n->_line;
+      e.name = n->_name;
+      e.ext = n->_ext;
+      e.callCnt = st.callCnt;
+      e.totalCost = st.totalCost;
+      memcpy(e.duration, st.duration, sizeof(e.duration));
+      p.entries.push_back(e);
+    }
+    return p;
+  }
+
+  // public
+  EZPP_INLINE bool
+  ezpp::saveProfile(const std::string& file) {
+    return snapshot().save(expandName(file));
+  }
+
+  namespace detail {
+    // fields are tab separated and records newline separated
+    inline std::string field(const std::string& s) {
+      std::string r(s);
+      for (size_t i = 0; i < r.size(); ++i) {
+        if (r[i] == '\t' || r[i] == '\r' || r[i] == '\n') {
+          r[i] = ' ';
+        }
+      }
+      return r;
+    }
+
+    inline void split(const std::string& s, const char* seps, std::vector<std::string>& out) {
+      out.clear();
+      size_t begin = 0;
+      while (begin <= s.size()) {
+        size_t end = s.find_first_of(seps, begin);
+        if (end == std::string::npos) {
+          end = s.size();
+        }
+        out.push_back(s.substr(begin, end - begin));
+        begin = end + 1;
+      }
+    }
+
+    // little endian base 128, signed values zigzag encoded so that small negatives stay short
+    inline void put_uvarint(std::string& out, unsigned long long v) {
+      while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+      }
+      out += (char)v;
+    }
+
+    inline void put_svarint(std::string& out, int64_t v) {
+      put_uvarint(out, ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63));
+    }
+
+    // reads past the end or an overlong varint fail the whole read, see ok()
+    class varint_reader {
+    public:
+      varint_reader(const char* begin, const char* end)
+        : _p((const unsigned char*)begin), _end((const unsigned char*)end), _ok(true) {}
+
+      unsigned long long u() {
+        unsigned long long v = 0;
+        for (int shift = 0; shift < 64 && _p < _end; shift += 7) {
+          unsigned char b = *_p++;
+          v |= (unsigned long long)(b & 0x7f) << shift;
+          if (!(b & 0x80)) {
+            return v;
+          }
+        }
+        _ok = false;
+        return 0;
+      }
+
+      int64_t s() {
+        unsigned long long v = u();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+      }
+
+      std::string str() {
+        unsigned long long len = u();
+        if (len > remaining()) {
+          _ok = false;
+          return std::string();
+        }
+        _p += len;
+        return std::string((const char*)_p - len, (size_t)len);
+      }
+
+      // every item takes a byte at least, larger counts come from a broken file
+      size_t count() {
+        unsigned long long cnt = u();
+        if (cnt > remaining()) {
+          _ok = false;
+          return 0;
+        }
+        return (size_t)cnt;
+      }
+
+      inline size_t remaining() const { return (size_t)(_end - _p); }
+      inline bool ok() const          { return _ok; }
+
+    private:
+      const unsigned char* _p;
+      const unsigned char* _end;
+      bool                 _ok;
+    };
+
+    // read-only view of a whole file, mapped where mmap is available and copied elsewhere
+    class mapped_file {
+    public:
+      mapped_file() : _data(0), _size(0), _mapped(false) {}
+      ~mapped_file() {
+      #ifndef _WIN32
+        if (_mapped) {
+          munmap((void*)_data, _size);
+        }
+      #endif
+      }
+
+      bool open(const std::string& file) {
+      #ifndef _WIN32
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0) {
+          return false;
+        }
+        struct ::stat st;
+        if (!fstat(fd, &st) && st.st_size > 0) {
+          void* p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (p != MAP_FAILED) {
+            _data = (const char*)p;
+            _size = (size_t)st.st_size;
+            _mapped = true;
+          }
+        }
+        ::close(fd);
+        if (_mapped) {
+          return true;
+        }
+      #endif
+        FILE* fp = fopen(file.c_str(), "rb");
+        if (!fp) {
+          return false;
+        }
+        char buf[4096];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+          _copy.append(buf, len);
+        }
+        fclose(fp);
+        _data = _copy.data();
+        _size = _copy.size();
+        return true;
+      }
+
+      inline const char* data() const { return _data; }
+      inline size_t size() const       { return _size; }
+
+    private:
+      mapped_file(const mapped_file&);
+      mapped_file& operator=(const mapped_file&);
+
+      const char* _data;
+      size_t      _size;
+      bool        _mapped;
+      std::string _copy;
+    };
+
+    // each distinct string is written once and referred to by its index
+    class string_table {
+    public:
+      unsigned long long index(const std::string& s) {
+        std::map<std::string, unsigned long long>::iterator it = _idx.find(s);
+        if (it == _idx.end()) {
+          it = _idx.insert(std::make_pair(s, (unsigned long long)_strs.size())).first;
+          _strs.push_back(&it->first);
+        }
+        return it->second;
+      }
+
+      void write(std::string& out) const {
+        put_uvarint(out, _strs.size());
+        for (size_t i = 0; i < _strs.size(); ++i) {
+          put_uvarint(out, _strs[i]->size());
+          out += *_strs[i];
+        }
+      }
+
+    private:
+      std::map<std::string, unsigned long long> _idx;
+      std::vector<const std::string*>           _strs;
+    };
+
+    // sites of version 1 files have no id, their place in the source tells them apart
+    inline std::string line_key(const profile::entry& e) {
+      char buf[16];
+      sprintf(buf, "\t%d", e.line);
+      return e.key() + buf;
+    }
+
+    static bool EntryLineSort(const profile::entry* lhs, const profile::entry* rhs) {
+      return lhs->line < rhs->line;
+    }
+
+    static bool ImpactSort(const profile::delta& lhs, const profile::delta& rhs) {
+      return lhs.impact() > rhs.impact();
+    }
+  }
+
+  // public
+  EZPP_INLINE std::string
+  profile::entry::key() const {
+    size_t slash = file.find_last_of("/\\");
+    return (slash == std::string::npos ? file : file.substr(slash + 1)) + '\t' + name + '\t' + ext;
+  }
+
+  // public, EZPP_PROFILE_MAGIC then varints: version, elapsed, process count, the string table,
+  // the sites with file, name and ext as string indices and their non-empty duration buckets as
+  // bucket, count pairs and their time per thread, then the edges. built in memory and written at once
+  EZPP_INLINE bool
+  profile::save(const std::string& file) const {
+    detail::alloc_mute mute;
+    detail::string_table strs;
+    std::string body;
+    detail::put_uvarint(body, entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      const entry& e = entries[i];
+      detail::put_uvarint(body, e.id);
+      detail::put_uvarint(body, strs.index(e.file));
+      detail::put_svarint(body, e.line);
+      detail::put_uvarint(body, strs.index(e.name));
+      detail::put_uvarint(body, strs.index(e.ext));
+      detail::put_svarint(body, e.callCnt);
+      detail::put_svarint(body, e.totalCost);
+      detail::put_svarint(body, e.selfCost);
+      detail::put_svarint(body, e.cpuCost);
+      detail::put_svarint(body, e.allocCnt);
+      detail::put_svarint(body, e.allocBytes);
+      size_t used = 0;
+      for (size_t j = 0; j < EZPP_HIST_BUCKETS; ++j) {
+        used += e.duration[j] != 0;
+      }
+      detail::put_uvarint(body, used);
+      for (size_t j = 0; j < EZPP_HIST_BUCKETS; ++j) {
+        if (e.duration[j]) {
+          detail::put_uvarint(body, j);
+          detail::put_svarint(body, e.duration[j]);
+        }
+      }
+      detail::put_uvarint(body, e.threadCost.size());
+      for (std::map<unsigned long long, int64_t>::const_iterator it = e.threadCost.begin(); it != e.threadCost.end(); ++it) {
+        detail::put_uvarint(body, it->first);
+        detail::put_svarint(body, it->second);
+      }
+    }
+    detail::put_uvarint(body, edges.size());
+    for (size_t i = 0; i < edges.size(); ++i) {
+      detail::put_uvarint(body, edges[i].parent);
+      detail::put_uvarint(body, edges[i].child);
+      detail::put_svarint(body, edges[i].callCnt);
+      detail::put_svarint(body, edges[i].totalCost);
+    }
+
+    std::string data(EZPP_PROFILE_MAGIC);
+    detail::put_uvarint(data, EZPP_PROFILE_VERSION);
+    detail::put_svarint(data, elapsed);
+    detail::put_svarint(data, processCnt);
+    strs.write(data);
+    data += body;
+
+    FILE* fp = fopen(file.c_str(), "wb+");
+    if (!fp) {
+      return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return fclose(fp) == 0 && ok;
+  }
+
+  // public
+  EZPP_INLINE bool
+  profile::load(const std::string& file) {
+    detail::mapped_file mf;
+    if (!mf.open(file)) {
+      return false;
+    }
+
+    entries.clear();
+    edges.clear();
+    processCnt = 1;
+    size_t magic = sizeof(EZPP_PROFILE_MAGIC) - 1;
+    if (mf.size() >= magic && !memcmp(mf.data(), EZPP_PROFILE_MAGIC, magic)) {
+      // decoded straight from the mapping, only the strings are copied
+      detail::varint_reader r(mf.data() + magic, mf.data() + mf.size());
+      unsigned long long version = r.u();
+      if (version < 3 || version > EZPP_PROFILE_VERSION) {
+        return false;
+      }
+      elapsed = r.s();
+      processCnt = r.s();
+      std::vector<std::string> strs(r.count());
+      for (size_t i = 0; i < strs.size() && r.ok(); ++i) {
+        strs[i] = r.str();
+      }
+      size_t cnt = r.count();
+      for (size_t i = 0; i < cnt && r.ok(); ++i) {
+        entry e;
+        e.id = (size_t)r.u();
+        unsigned long long file = r.u();
+        e.line = (int)r.s();
+        unsigned long long name = r.u();
+        unsigned long long ext = r.u();
+        if (file >= strs.size() || name >= strs.size() || ext >= strs.size()) {
+          return false;
+        }
+        e.file = strs[(size_t)file];
+        e.name = strs[(size_t)name];
+        e.ext = strs[(size_t)ext];
+        e.callCnt = r.s();
+        e.totalCost = r.s();
+        e.selfCost = r.s();
+        e.cpuCost = r.s();
+        e.allocCnt = r.s();
+        e.allocBytes = r.s();
+        size_t used = r.count();
+        for (size_t j = 0; j < used; ++j) {
+          unsigned long long bucket = r.u();
+          int64_t bucketCnt = r.s();
+          if (bucket < EZPP_HIST_BUCKETS) {
+            e.duration[bucket] = bucketCnt;
+          }
+        }
+        // version 3 had no time per thread
+        used = version > 3 ? r.count() : 0;
+        for (size_t j = 0; j < used; ++j) {
+          unsigned long long thread = r.u();
+          e.threadCost[thread] = r.s();
+        }
+        entries.push_back(e);
+      }
+      cnt = r.count();
+      for (size_t i = 0; i < cnt && r.ok(); ++i) {
+        edge ed;
+        ed.parent = (size_t)r.u();
+        ed.child = (size_t)r.u();
+        ed.callCnt = r.s();
+        ed.totalCost = r.s();
+        edges.push_back(ed);
+      }
+      return r.ok();
+    }
+
+    std::string text(mf.data(), mf.size());
+    std::vector<std::string> lines, fields, pairs;
+    detail::split(text, "\r\n", lines);
+    detail::split(lines[0], "\t", fields);
+    int version = fields.size() < 3 || fields[0] != "ezpp-profile" ? 0 : atoi(fields[1].c_str());
+    // text up to version 2
+    if (version < 1 || version > 2) {
+      return false;
+    }
+    // version 1 had no ids
+    size_t f = version > 1 ? 1 : 0;
+    elapsed = strtoll(fields[2].c_str(), 0, 10);
+    for (size_t i = 1; i < lines.size(); ++i) {
+      if (lines[i].empty()) {
+        continue;
+      }
+      detail::split(lines[i], "\t", fields);
+      if (fields.size() < 11 + f) {
+        return false;
+      }
+      entry e;
+      e.id = f ? (size_t)strtoull(fields[0].c_str(), 0, 16) : 0;
+      e.file = fields[f];
+      e.line = atoi(fields[f + 1].c_str());
+      e.name = fields[f + 2];
+      e.ext = fields[f + 3];
+      e.callCnt = strtoll(fields[f + 4].c_str(), 0, 10);
+      e.totalCost = strtoll(fields[f + 5].c_str(), 0, 10);
+      e.selfCost = strtoll(fields[f + 6].c_str(), 0, 10);
+      e.cpuCost = strtoll(fields[f + 7].c_str(), 0, 10);
+      e.allocCnt = strtoll(fields[f + 8].c_str(), 0, 10);
+      e.allocBytes = strtoll(fields[f + 9].c_str(), 0, 10);
+      detail::split(fields[f + 10], ",", pairs);
+      for (size_t j = 0; j < pairs.size(); ++j) {
+        size_t bucket = (size_t)atoi(pairs[j].c_str());
+        size_t colon = pairs[j].find(':');
+        if (colon != std::string::npos && bucket < EZPP_HIST_BUCKETS) {
+          e.duration[bucket] = strtoll(pairs[j].c_str() + colon + 1, 0, 10);
+        }
+      }
+      entries.push_back(e);
+    }
+    return true;
+  }
+
+  // public
+  EZPP_INLINE void
+  profile::merge(const profile& other) {
+    std::map<size_t, size_t> ids;
+    std::map<std::string, size_t> keys;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (entries[i].id) {
+        ids[entries[i].id] = i;
+      }
+      else {
+        keys[detail::line_key(entries[i])] = i;
+      }
+    }
+    for (size_t i = 0; i < other.entries.size(); ++i) {
+      const entry& o = other.entries[i];
+      size_t at = entries.size();
+      if (o.id) {
+        std::map<size_t, size_t>::iterator it = ids.find(o.id);
+        if (it != ids.end()) {
+          at = it->second;
+        }
+        else {
+          ids[o.id] = at;
+        }
+      }
+      else {
+        std::string k = detail::line_key(o);
+        std::map<std::string, size_t>::iterator it = keys.find(k);
+        if (it != keys.end()) {
+          at = it->second;
+        }
+        else {
+          keys[k] = at;
+        }
+      }
+      if (at == entries.size()) {
+        entries.push_back(o);
+        continue;
+      }
+      entry& e = entries[at];
+      e.callCnt += o.callCnt;
+      e.totalCost += o.totalCost;
+      e.selfCost += o.selfCost;
+      e.cpuCost += o.cpuCost;
+      e.allocCnt += o.allocCnt;
+      e.allocBytes += o.allocBytes;
+      for (size_t j = 0; j < EZPP_HIST_BUCKETS; ++j) {
+        e.duration[j] += o.duration[j];
+      }
+      for (std::map<unsigned long long, int64_t>::const_iterator it = o.threadCost.begin(); it != o.threadCost.end(); ++it) {
+        e.threadCost[it->first] += it->second;
+      }
+    }
+
+    std::map<std::pair<size_t, size_t>, size_t> ends;
+    for (size_t i = 0; i < edges.size(); ++i) {
+      ends[std::make_pair(edges[i].parent, edges[i].child)] = i;
+    }
+    for (size_t i = 0; i < other.edges.size(); ++i) {
+      const edge& o = other.edges[i];
+      std::map<std::pair<size_t, size_t>, size_t>::iterator it = ends.find(std::make_pair(o.parent, o.child));
+      if (it == ends.end()) {
+        ends[std::make_pair(o.parent, o.child)] = edges.size();
+        edges.push_back(o);
+        continue;
+      }
+      edges[it->second].callCnt += o.callCnt;
+      edges[it->second].totalCost += o.totalCost;
+    }
+
+    // thread ids only mean something inside their process, the same id of another process or
+    // host is a different thread, so a merge of two processes keeps no per thread figures
+    if (processCnt && other.processCnt) {
+      for (size_t i = 0; i < entries.size(); ++i) {
+        entries[i].threadCost.clear();
+      }
+    }
+
+    if (other.elapsed > elapsed) {
+      elapsed = other.elapsed;
+    }
+    processCnt += other.processCnt;
+  }
+
+  // public static, sites are matched by id, the rest sharing a key are paired in line order
+  EZPP_INLINE std::vector<profile::delta>
+  profile::diff(const profile& before, const profile& after) {
+    std::vector<delta> deltas;
+    std::map<size_t, const entry*> ids;
+    for (size_t i = 0; i < before.entries.size(); ++i) {
+      if (before.entries[i].id) {
+        ids[before.entries[i].id] = &before.entries[i];
+      }
+    }
+    std::map<const entry*, bool> matched;
+    for (size_t i = 0; i < after.entries.size(); ++i) {
+      std::map<size_t, const entry*>::iterator it = after.entries[i].id ? ids.find(after.entries[i].id) : ids.end();
+      if (it != ids.end() && !matched.count(it->second)) {
+        delta d;
+        d.before = it->second;
+        d.after = &after.entries[i];
+        deltas.push_back(d);
+        matched[d.before] = matched[d.after] = true;
+      }
+    }
+
+    typedef std::map<std::string, std::pair<std::vector<const entry*>, std::vector<const entry*> > > index;
+    index idx;
+    for (size_t i = 0; i < before.entries.size(); ++i) {
+      if (!matched.count(&before.entries[i])) {
+        idx[before.entries[i].key()].first.push_back(&before.entries[i]);
+      }
+    }
+    for (size_t i = 0; i < after.entries.size(); ++i) {
+      if (!matched.count(&after.entries[i])) {
+        idx[after.entries[i].key()].second.push_back(&after.entries[i]);
+      }
+    }
+    for (index::iterator it = idx.begin(); it != idx.end(); ++it) {
+      std::vector<const entry*>& b = it->second.first;
+      std::vector<const entry*>& a = it->second.second;
+      std::sort(b.begin(), b.end(), detail::EntryLineSort);
+      std::sort(a.begin(), a.end(), detail::EntryLineSort);
+      for (size_t i = 0; i < b.size() || i < a.size(); ++i) {
+        delta d;
+        d.before = i < b.size() ? b[i] : 0;
+        d.after = i < a.size() ? a[i] : 0;
+        deltas.push_back(d);
+      }
+    }
+    std::stable_sort(deltas.begin(), deltas.end(), detail::ImpactSort);
+    return deltas;
+  }
+
+  namespace detail {
+    inline void outputChange(FILE* fp, int64_t before, int64_t after) {
+      if (before) {
+        fprintf(fp, " (%+.1f%%)", (double)(after - before) * 100 / before);
+      }
+      fprintf(fp, "\r\n");
+    }
+
+    inline void outputEntry(FILE* fp, const profile::entry& e) {
+      fprintf(fp, "[Name] %s (%s:%d)", e.name.c_str(), e.file.c_str(), e.line);
+      if (!e.ext.empty()) {
+        fprintf(fp, " \"%s\"", e.ext.c_str());
+      }
+      fprintf(fp, "\r\n");
+    }
+  }
+
+  // public static
+  EZPP_INLINE void
+  profile::output(FILE* fp, const profile& before, const profile& after, const std::vector<delta>& deltas) {
+    fprintf(fp, "========== Easy Performance Profiler Diff ==========\r\n");
+    fprintf(fp, "[Elapsed] ");
+    ezpp::outputTime(fp, before.elapsed);
+    fprintf(fp, " -> ");
+    ezpp::outputTime(fp, after.elapsed);
+    detail::outputChange(fp, before.elapsed, after.elapsed);
+
+    static const char* titles[] = { "Changed", "New", "Vanished" };
+    for (int section = 0; section < 3; ++section) {
+      size_t no = 0;
+      for (size_t i = 0; i < deltas.size(); ++i) {
+        const delta& d = deltas[i];
+        if ((section == 0) != (d.before && d.after) || (section == 1 && d.before) || (section == 2 && d.after)) {
+          continue;
+        }
+        if (!no) {
+          fprintf(fp, "\r\n     [%s]\r\n", titles[section]);
+        }
+        fprintf(fp, "\r\nNo.%u\r\n", (unsigned)++no);
+        if (section) {
+          const entry& e = d.before ? *d.before : *d.after;
+          detail::outputEntry(fp, e);
+          fprintf(fp, "[Call] %" PRId64 "\r\n[Time] ", e.callCnt);
+          ezpp::outputTime(fp, e.totalCost);
+          fprintf(fp, ", mean ");
+          ezpp::outputTime(fp, e.mean());
+          fprintf(fp, "\r\n");
+          continue;
+        }
+        const entry& b = *d.before;
+        const entry& a = *d.after;
+        detail::outputEntry(fp, a);
+        fprintf(fp, "[Call] %" PRId64 " -> %" PRId64, b.callCnt, a.callCnt);
+        detail::outputChange(fp, b.callCnt, a.callCnt);
+        fprintf(fp, "[Time] ");
+        ezpp::outputTime(fp, b.totalCost);
+        fprintf(fp, " -> ");
+        ezpp::outputTime(fp, a.totalCost);
+        detail::outputChange(fp, b.totalCost, a.totalCost);
+        fprintf(fp, "[Mean] ");
+        ezpp::outputTime(fp, b.mean());
+        fprintf(fp, " -> ");
+        ezpp::outputTime(fp, a.mean());
+        detail::outputChange(fp, b.mean(), a.mean());
+        if (b.p99() || a.p99()) {
+          fprintf(fp, "[P99] <= ");
+          ezpp::outputTime(fp, b.p99());
+          fprintf(fp, " -> <= ");
+          ezpp::outputTime(fp, a.p99());
+          detail::outputChange(fp, b.p99(), a.p99());
+        }
+      }
+    }
+    fprintf(fp, "\r\n");
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::clear() {
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_clearLock);
+    // scopes starting from here on find the new maps, the old ones go once nobody reads them
+    std::atomic<node_map*>* maps[] = { &_doMap, &_nodeMap };
+    for (size_t i = 0; i < 2; ++i) {
+      node_map* old = maps[i]->exchange(new node_map(EZPP_NODE_MAX + EZPP_FN_MAX));
+      std::for_each(old->cbegin(), old->cend(), ezpp::release);
+      retire(old, deleteMap);
+    }
+    resetGlobals(time_now());
+    reclaim(true);
+  }
+
+  // public
+  EZPP_INLINE void
+  ezpp::reset() {
+    detail::alloc_mute mute;
+    detail::spin_guard guard(_clearLock);
+    detail::epoch_guard epoch;
+    int64_t now = time_now();
+    _resetAt = now;
+    std::atomic<node_map*>* maps[] = { &_doMap, &_nodeMap };
+    for (size_t i = 0; i < 2; ++i) {
+      const node_map& map = *maps[i]->load(std::memory_order_acquire);
+      for (node_map::const_iterator it = map.cbegin(); it != map.cend(); ++it) {
+        it->second.data->reset(now);
+      }
+    }
+    resetGlobals(now);
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::resetGlobals(int64_t now) {
+    _resetAt = now;
+  #ifdef __linux__
+    drainSamples(true);
+    {
+      detail::spin_guard guard(_sampleLock);
+      _samples.clear();
+      _sampleDropped = 0;
+    }
+  #endif
+    _allocCnt = _allocBytes = _freeCnt = 0;
+    for (detail::counter_block* b = _counterBlocks; b; b = b->next) {
+      for (size_t i = 0; i < EZPP_COUNTER_MAX; ++i) {
+        b->values[i] = 0;
+      }
+    }
+    {
+      detail::spin_guard guard(_lockLock);
+      for (lock_map::iterator it = _lockMap.begin(); it != _lockMap.end(); ++it) {
+        it->second->reset();
+      }
+    }
+    _slowest.reset();
+    _begin = now;
+  }
+
+  // protected
+  EZPP_INLINE void
+  ezpp::removeDoNode(size_t id) {
+    _doMap.load(std::memory_order_acquire)->erase(id);
+  }
+
+#ifndef _WIN32
+  // protected static, no lock may be held by another thread when the child starts with one thread
+  EZPP_INLINE void
+  ezpp::forkPrepare() {
+    ezpp& pp = inst();
+    pp._clearLock.lock();
+    pp._retireLock.lock();
+    pp._dumpLock.lock();
+  #ifdef __linux__
+    pp._sampleLock.lock();
+  #endif
+    pp._fnLock.lock();
+    pp._filterLock.lock();
+    pp._lockLock.lock();
+    pp._shmLock.lock();
+    pp._slowest._lock.lock();
+  }
+
+  // protected static
+  EZPP_INLINE void
+  ezpp::forkParent() {
+    ezpp& pp = inst();
+    pp._slowest._lock.unlock();
+    pp._shmLock.unlock();
+    pp._lockLock.unlock();
+    pp._filterLock.unlock();
+    pp._fnLock.unlock();
+  #ifdef __linux__
+    pp._sampleLock.unlock();
+  #endif
+    pp._dumpLock.unlock();
+    pp._retireLock.unlock();
+    pp._clearLock.unlock();
+  }
+
+  // protected static, what was measured so far is the parent's and saved by the parent
+  EZPP_INLINE void
+  ezpp::forkChild() {
+    forkParent();
+    ezpp& pp = inst();
+    pp._forked = true;
+    // the inherited mapping is the parent's segment, scopes open across fork stop publishing
+    node_map* maps[] = { pp._doMap.load(), pp._nodeMap.load() };
+    for (size_t i = 0; i < 2; ++i) {
+      for (node_map::const_iterator it = maps[i]->cbegin(); it != maps[i]->cend(); ++it) {
+        it->second.data->_shm = 0;
+      }
+    }
+    detail::tls_ctx& t = detail::tls();
+    // the other threads are gone, and so are their guards
+    for (detail::epoch_slot* slot = pp._slots; slot; slot = slot->next) {
+      if (slot != t.slot) {
+        slot->active = 0;
+      }
+    }
+    detail::exec_ctx& ctx = detail::exec(t);
+    for (int i = 0; i < ctx.depth; ++i) {
+      ctx.stack[i].n->_shm = 0;
+    }
+    pp._shmMap.clear();
+    pp._shm.detach();
+    if ((pp._option & EZPP_OPT_SHM) && !pp._shm.create()) {
+      pp._option &= ~EZPP_OPT_SHM;
+    }
+    // counters and clocks of the forking thread belong to the parent's thread
+    for (int i = 0; i < ctx.depth; ++i) {
+      ctx.stack[i].perf = ctx.stack[i].cpu = ctx.stack[i].ru = false;
+    }
+  #ifdef __linux__
+    detail::perf_close(t.perf);
+    t.perfState = 0;
+  #endif
+    t.tid = 0;
+    ctx.allocCnt = ctx.allocBytes = ctx.freeCnt = 0;
+    // the helper stayed with the parent, and so would the requests sent to its pipe
+    if (pp._dumpPipe[0] >= 0) {
+      int fds[2] = { pp._dumpPipe[0], pp._dumpPipe[1] };
+      pp._dumpPipe[1] = -1;
+      close(fds[0]);
+      close(fds[1]);
+      pp._dumpSeq = 0;
+      if (!pp.startDump()) {
+        pp._dumpSignals = 0;
+      }
+    }
+  #ifdef __linux__
+    // timers aren't inherited, the blocks of the other threads are free for new ones
+    for (detail::sample_block* b = pp._sampleBlocks; b; b = b->next) {
+      b->armed = false;
+      if (b != t.samples) {
+        b->used = 0;
+      }
+    }
+    t.sampleHz = 0;
+  #endif
+    pp.clear();
+  }
+#endif
 
   // public
-  void
-  ezpp::addOption(unsigned char optModify) {
+  EZPP_INLINE void
+  ezpp::addOption(unsigned int optModify) {
     if (optModify & EZPP_OPT_SWITCH) {
       if ((optModify & EZPP_OPT_FORCE_ENABLE) && !_enabled) {
         _enabled = true;
@@ -1034,12 +4929,21 @@ namespace ezpp {
       _option &= ~EZPP_OPT_SORT;
       _option |= (optModify & EZPP_OPT_SORT);
     }
-    _option |= (optModify & EZPP_OPT_SAVE_IN_DTOR);
+    if ((optModify & EZPP_OPT_PERF_COUNTER) && !(_option & EZPP_OPT_PERF_COUNTER)) {
+      _perfKind = detail::perf_probe();
+    }
+    if (optModify & EZPP_OPT_SHM) {
+      detail::spin_guard guard(_shmLock);
+      if (!_shm.valid() && !_shm.create()) {
+        optModify &= ~EZPP_OPT_SHM;
+      }
+    }
+    _option |= (optModify & (EZPP_OPT_SAVE_IN_DTOR | EZPP_OPT_CLS_DETAIL | EZPP_OPT_PERF_COUNTER | EZPP_OPT_CPU_TIME | EZPP_OPT_RUSAGE | EZPP_OPT_SHM));
   }
 
   // public
-  void
-  ezpp::removeOption(unsigned char optModify) {
+  EZPP_INLINE void
+  ezpp::removeOption(unsigned int optModify) {
     if ((optModify & EZPP_OPT_FORCE_DISABLE) && !_enabled) {
       _enabled = true;
       _begin = time_now();
@@ -1047,124 +4951,823 @@ namespace ezpp {
     if ((optModify & EZPP_OPT_FORCE_ENABLE) && _enabled) {
       _enabled = false;
     }
+    if (optModify & EZPP_OPT_PERF_COUNTER) {
+      _perfKind = EZPP_PERF_NONE;
+    }
     _option &= ~optModify;
   }
 
   // protected
-  node::node(size_t id, size_t c12n, unsigned char flags)
+  EZPP_INLINE node::node(size_t id, size_t c12n, unsigned char flags)
     : _id(id)
     , _beginMap(EZPP_NODE_MAX)
     , _costMap(EZPP_NODE_MAX)
     , _refMap(EZPP_NODE_MAX)
+    , _created(time_now())
     , _start(0)
     , _totalCost(0)
     , _callCnt(1)
     , _totalRefCnt(1)
+    , _allocCnt(0)
+    , _allocBytes(0)
+    , _freeCnt(0)
+    , _cpuCnt(0)
+    , _cpuCost(0)
+    , _cpuWall(0)
+    , _perfKind(EZPP_PERF_NONE)
+    , _perfCnt(0)
+    , _ruCnt(0)
+    , _ruMap(0)
+    , _selfCost(0)
+    , _childCost(0)
+    , _window(0)
+    , _suspendCost(0)
+    , _queueCost(0)
+    , _budget(0)
+    , _overCnt(0)
+    , _slow(0)
+    , _edgeMap(0)
+    , _shm(0)
+    , _published(0)
     , _flags(flags)
     , _releaseUntilEnd(false)
+    , _retired(0)
     , _file(0)
     , _line(0)
     , _endLine(0)
     , _name()
     , _ext()
   {
+    for (size_t i = 0; i < EZPP_PERF_MAX; ++i) {
+      _perf[i] = 0;
+    }
+    for (size_t i = 0; i < EZPP_RUSAGE_MAX; ++i) {
+      _ru[i] = 0;
+    }
+    for (size_t i = 0; i < EZPP_COUNTER_MAX; ++i) {
+      _counters[i] = 0;
+    }
     if (_flags & EZPP_NODE_AUTO_START)
       begin(c12n);
+    else if (_flags & EZPP_NODE_SPAN)
+      _callCnt = _totalRefCnt = 0;
     else
       ++_totalRefCnt;
     _start = time_now();
   }
 
   // public
-  void 
+  EZPP_INLINE void
   node::begin(size_t c12n) {
+    if (aggregated()) {
+      _objs.born();
+      return;
+    }
     if (_beginMap.cbegin() != _beginMap.cend()) {
       call(c12n);
       return;
     }
-    _beginMap.insert(c12n, time_now());
+    int64_t now = time_now();
+    _beginMap.insert(c12n, now);
     _costMap.insert(c12n, 0);
     _refMap.insert(EZPP_THREAD_ID, 1);
+    enter(now);
   }
 
   #define _GET_(m, k) m.findOrConstruct(k, atomic_init, (const folly::MutableAtom<int64_t>*)0).first->second.data
 
   // public
-  void 
+  EZPP_INLINE bool
   node::call(size_t c12n) {
+    // the reference is taken before the check, so a retire() we don't see can't free us anymore
+    int64_t refs = _totalRefCnt++;
+    if (UNLIKELY(_retired.load())) {
+      --_totalRefCnt;
+      return false;
+    }
     int64_t now = time_now();
-    if (!_GET_(_refMap, c12n)++ || (_flags & EZPP_NODE_CLS))
+    if (aggregated()) {
+      _objs.born();
+    }
+    else if (!_GET_(_refMap, c12n)++ || (_flags & EZPP_NODE_CLS))
       _GET_(_beginMap, c12n) = now;
-    if (!_totalRefCnt)
+    if (!refs)
       _start = now;
-    ++_totalRefCnt;
     ++_callCnt;
+    enter(now);
+    return true;
   }
 
   // public
-  void 
+  EZPP_INLINE void
   node::end(size_t c12n) {
-    --_totalRefCnt;
+    // the last reference may be dropped by another thread while we are still in here
+    detail::epoch_guard guard;
     int64_t now = time_now();
+    leave(c12n, now);
+    int64_t refs = --_totalRefCnt;
     if (!--_GET_(_refMap, c12n) || (_flags & EZPP_NODE_CLS)) {
       _GET_(_costMap, c12n) += now - _GET_(_beginMap, c12n);
     }
-    if (!_totalRefCnt) {
+    if (!refs) {
+      _totalCost += now - _start;
+    }
+    if (_shm && publish(now, refs)) {
+      // scopes around us, e.g. a main loop, may never end to publish themselves
+      detail::exec_ctx& ctx = detail::exec(detail::tls());
+      for (int i = 0; i < ctx.depth; ++i) {
+        node* n = ctx.stack[i].n;
+        if (n->_shm) {
+          n->publish(now, n->_totalRefCnt);
+        }
+      }
+    }
+    if (!refs) {
+      idle();
+    }
+  }
+
+  // public
+  EZPP_INLINE void
+  node::destroy(size_t obj, int64_t birth) {
+    if (!aggregated()) {
+      end(obj);
+      return;
+    }
+    detail::epoch_guard guard;
+    int64_t refs = --_totalRefCnt;
+    int64_t now = time_now();
+    _objs.died(obj, now - birth);
+    if (!refs) {
+      _totalCost += now - _start;
+    }
+    if (_shm) {
+      publish(now, refs);
+    }
+    if (!refs) {
+      idle();
+    }
+  }
+
+  // public, returns the start time
+  EZPP_INLINE int64_t
+  node::spanBegin() {
+    int64_t now = time_now();
+    if (!_totalRefCnt++)
+      _start = now;
+    ++_callCnt;
+    return now;
+  }
+
+  // public
+  EZPP_INLINE void
+  node::spanEnd(int64_t begin, int64_t queued) {
+    detail::epoch_guard guard;
+    int64_t now = time_now();
+    // started before the last reset
+    int64_t resetAt = inst()._resetAt.load(std::memory_order_relaxed);
+    if (UNLIKELY(begin < resetAt)) {
+      queued = queued > resetAt - begin ? queued - (resetAt - begin) : 0;
+      begin = resetAt;
+    }
+    int64_t elapsed = now - begin;
+    _selfCost += elapsed;
+    _queueCost += queued;
+    _duration.add(elapsed);
+    addRecent(now, elapsed);
+    int64_t refs = --_totalRefCnt;
+    if (!refs) {
       _totalCost += now - _start;
+    }
+    if (_shm) {
+      publish(now, refs);
+    }
+    if (!refs) {
+      idle();
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  node::enter(int64_t now) {
+    if (_flags & EZPP_NODE_CLS) {
+      return;
+    }
+    detail::tls_ctx& t = detail::tls();
+    detail::exec_ctx& ctx = detail::exec(t);
+    if (ctx.depth >= EZPP_STACK_MAX) {
+      return;
+    }
+    if (!ctx.depth) {
+      inst().chargeUnscoped(ctx.allocCnt, ctx.allocBytes, ctx.freeCnt);
+      ctx.allocCnt = ctx.allocBytes = ctx.freeCnt = 0;
+    }
+    // the frame is complete for the sampling handler before it is counted
+    detail::frame& f = ctx.stack[ctx.depth];
+    f.n = this;
+    detail::compiler_fence();
+    ++ctx.depth;
+    f.begin = now;
+    f.child = 0;
+    f.suspendBegin = ctx.suspended;
+    f.counterMask = 0;
+    f.allocCnt = ctx.allocCnt;
+    f.allocBytes = ctx.allocBytes;
+    f.freeCnt = ctx.freeCnt;
+    ctx.allocCnt = ctx.allocBytes = ctx.freeCnt = 0;
+    ezpp& pp = inst();
+    f.budget = pp._budget.load(std::memory_order_relaxed);
+    f.cpu = (_flags & EZPP_NODE_CPU_TIME) || (pp._option & EZPP_OPT_CPU_TIME);
+    if (f.cpu) {
+      f.wallBegin = time_now();
+      f.cpuBegin = time_cpu();
+    }
+    f.ru = (pp._option & EZPP_OPT_RUSAGE) && detail::thread_rusage(f.ruBegin);
+  #ifdef __linux__
+    // the timer follows the rate lazily, the buffer is drained before it overflows
+    if (UNLIKELY(t.sampleHz != pp._sampleHz.load(std::memory_order_relaxed))) {
+      pp.armSampling(t);
+    }
+    if (t.samples && UNLIKELY(t.samples->pending() > EZPP_SAMPLE_BUF / 2)) {
+      pp.drainSamples(false);
+    }
+  #endif
+    // read last to keep our own bookkeeping out of the counters
+    f.perf = pp._perfKind && detail::perf_ready(t, pp._perfKind) && detail::perf_read(t.perf, f.perfBegin);
+  }
+
+  // protected
+  EZPP_INLINE void
+  node::leave(size_t c12n, int64_t now) {
+    if (_flags & EZPP_NODE_CLS) {
+      return;
+    }
+    detail::tls_ctx& t = detail::tls();
+    detail::exec_ctx& ctx = detail::exec(t);
+    int i = ctx.depth - 1;
+    while (i >= 0 && ctx.stack[i].n != this) {
+      --i;
+    }
+    if (i < 0) {
+      return;
+    }
+    const detail::frame& f = ctx.stack[i];
+    int64_t elapsed = now - f.begin;
+    // self and nested times are running times, the context may have been switched out
+    int64_t suspended = ctx.suspended - f.suspendBegin;
+    int64_t child = f.child;
+    // entered before the last reset, only the part after it counts
+    int64_t resetAt = inst()._resetAt.load(std::memory_order_relaxed);
+    bool stale = UNLIKELY(f.begin < resetAt);
+    if (stale) {
+      elapsed = now - resetAt;
+      suspended = 0;
+      if (child > elapsed) {
+        child = elapsed;
+      }
+    }
+    if (suspended) {
+      _suspendCost += suspended;
+    }
+    _selfCost += elapsed - suspended - child;
+    _childCost += child;
+    _duration.add(elapsed);
+    addRecent(now, elapsed);
+    if (UNLIKELY(f.budget && elapsed > f.budget)) {
+      overBudget(ctx, i, elapsed, now);
+    }
+    for (unsigned mask = stale ? 0 : f.counterMask, j = 0; mask; mask >>= 1, ++j) {
+      if (mask & 1) {
+        _counters[j] += f.counters[j];
+      }
+    }
+    if (i > 0) {
+      ctx.stack[i - 1].child += elapsed - suspended;
+      addEdge(ctx.stack[i - 1].n->_id, elapsed);
+    }
+    if (!stale && (f.perf || f.cpu || f.ru)) {
+      // recursive calls are covered by the outermost one
+      bool outermost = true;
+      for (int j = 0; j < i && outermost; ++j) {
+        outermost = ctx.stack[j].n != this;
+      }
+      int64_t perfEnd[EZPP_PERF_MAX];
+      if (f.perf && outermost && detail::perf_read(t.perf, perfEnd)) {
+        for (int j = 0; j < t.perf.cnt; ++j) {
+          _perf[j] += perfEnd[j] - f.perfBegin[j];
+        }
+        _perfKind = t.perf.cnt == EZPP_PERF_MAX ? EZPP_PERF_HW : EZPP_PERF_SW;
+        ++_perfCnt;
+      }
+      if (f.cpu && outermost) {
+        _cpuCost += time_cpu() - f.cpuBegin;
+        _cpuWall += time_now() - f.wallBegin;
+        ++_cpuCnt;
+      }
+      int64_t ruEnd[EZPP_RUSAGE_MAX];
+      if (f.ru && outermost && detail::thread_rusage(ruEnd)) {
+        rusage_map* m = _ruMap;
+        if (!m) {
+          rusage_map* created = new rusage_map(EZPP_NODE_MAX);
+          if (_ruMap.compare_exchange_strong(m, created)) {
+            m = created;
+          }
+          else {
+            delete created;
+          }
+        }
+        const rusage_stat& stat = m->findOrConstruct(c12n, rusage_init, (const rusage_stat*)0).first->second;
+        for (size_t j = 0; j < EZPP_RUSAGE_MAX; ++j) {
+          _ru[j] += ruEnd[j] - f.ruBegin[j];
+          stat.values[j] += ruEnd[j] - f.ruBegin[j];
+        }
+        ++_ruCnt;
+      }
+    }
+    if (i == ctx.depth - 1) {
+      // innermost, the usual case
+      _allocCnt += ctx.allocCnt;
+      _allocBytes += ctx.allocBytes;
+      _freeCnt += ctx.freeCnt;
+      ctx.allocCnt = ctx.stack[i].allocCnt;
+      ctx.allocBytes = ctx.stack[i].allocBytes;
+      ctx.freeCnt = ctx.stack[i].freeCnt;
+    }
+    else {
+      // ended out of order, what it owned has been saved by the scope above it
+      detail::frame& above = ctx.stack[i + 1];
+      _allocCnt += above.allocCnt;
+      _allocBytes += above.allocBytes;
+      _freeCnt += above.freeCnt;
+      above.allocCnt = ctx.stack[i].allocCnt;
+      above.allocBytes = ctx.stack[i].allocBytes;
+      above.freeCnt = ctx.stack[i].freeCnt;
+      for (int j = i; j < ctx.depth - 1; ++j) {
+        ctx.stack[j] = ctx.stack[j + 1];
+      }
+    }
+    --ctx.depth;
+  }
+
+  // protected, the stack from the outermost scope down to i
+  EZPP_INLINE void
+  node::overBudget(const detail::exec_ctx& ctx, int i, int64_t elapsed, int64_t now) {
+    _budget.store(ctx.stack[i].budget, std::memory_order_relaxed);
+    ++_overCnt;
+    slow_log* m = _slow;
+    ezpp& pp = inst();
+    if (m && !m->slower(elapsed) && !pp._slowest.slower(elapsed)) {
+      return;
+    }
+    detail::alloc_mute mute;
+    if (!m) {
+      slow_log* created = new slow_log;
+      if (_slow.compare_exchange_strong(m, created)) {
+        m = created;
+      }
+      else {
+        delete created;
+      }
+    }
+    slow_log::entry e;
+    e.site = _id;
+    e.duration = elapsed;
+    e.when = now;
+    e.thread = (unsigned long long)detail::exec_id();
+    e.depth = i;
+    for (int j = 0; j < i; ++j) {
+      e.stack[j] = ctx.stack[j].n->_id;
+    }
+    memcpy(e.tag, ctx.tag, sizeof(e.tag));
+    m->add(e);
+    pp._slowest.add(e);
+  }
+
+  // public
+  EZPP_INLINE void
+  node::recent(int seconds, window::stat& out, int64_t now) const {
+    const window* w = _window;
+    if (w) {
+      w->get(now, seconds, inst()._begin, out);
+    }
+    else {
+      out.span = window::covered(now, seconds, inst()._begin);
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  node::addRecent(int64_t now, int64_t elapsed) {
+    if (_flags & EZPP_NODE_DIRECT_OUTPUT) {
+      return;
+    }
+    window* w = _window;
+    if (!w) {
+      detail::alloc_mute mute;
+      window* created = new window;
+      if (_window.compare_exchange_strong(w, created)) {
+        w = created;
+      }
+      else {
+        delete created;
+      }
+    }
+    w->add(now, elapsed);
+  }
+
+  // protected
+  EZPP_INLINE void
+  node::addEdge(size_t parent, int64_t elapsed) {
+    edge_map* m = _edgeMap;
+    if (!m) {
+      detail::alloc_mute mute;
+      edge_map* created = new edge_map(EZPP_NODE_MAX);
+      if (_edgeMap.compare_exchange_strong(m, created)) {
+        m = created;
+      }
+      else {
+        delete created;
+      }
+    }
+    const edge_stat& stat = m->findOrConstruct(parent, edge_init, (const edge_stat*)0).first->second;
+    ++stat.callCnt;
+    stat.totalCost += elapsed;
+  }
+
+  // protected, totals are published as a whole so a skipped update is carried by the next one.
+  // a site always open somewhere publishes every EZPP_SHM_PUBLISH_US from the scopes ending
+  EZPP_INLINE bool
+  node::publish(int64_t now, int64_t refs) {
+    if (!(inst()._option & EZPP_OPT_SHM)) {
+      return false;
+    }
+    if (refs && now - _published.load(std::memory_order_relaxed) < EZPP_SHM_PUBLISH_US) {
+      return false;
+    }
+    unsigned int seq = _shm->seq.load(std::memory_order_relaxed);
+    if ((seq & 1) || !_shm->seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire)) {
+      // another thread is publishing this site
+      return false;
+    }
+    _published.store(now, std::memory_order_relaxed);
+    _shm->data.callCnt = _callCnt;
+    _shm->data.totalCost = _totalCost + (refs > 0 ? now - _start : 0);
+    _shm->data.cpuCost = _cpuCost;
+    _shm->data.allocCnt = _allocCnt;
+    _shm->data.allocBytes = _allocBytes;
+    _shm->data.updated = now;
+    _shm->data.selfCost = _selfCost;
+    for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+      _shm->data.duration[i] = _duration.bucketCnt(i);
+    }
+    _shm->seq.store(seq + 2, std::memory_order_release);
+    return true;
+  }
+
+  // protected
+  EZPP_INLINE void
+  node::idle() {
+    // dropped by clear(), a newer node of the site may be in the maps already
+    if (_releaseUntilEnd)
+      retire();
+    else if ((_flags & EZPP_NODE_DIRECT_OUTPUT)) {
+      output(stdout);
+      inst().removeDoNode(_id);
+      retire();
+    }
+  }
+
+  // protected, freed once no other thread may still be in here
+  EZPP_INLINE void
+  node::retire() {
+    if (!_retired.exchange(1)) {
+      inst().retire(this, ezpp::deleteNode);
+    }
+  }
+
+  // protected
+  EZPP_INLINE void
+  node::reset(int64_t now) {
+    _created = now;
+    if (_totalRefCnt) {
+      _start = now;
+    }
+    _totalCost = 0;
+    _callCnt = 0;
+    for (time_map::const_iterator it = _refMap.cbegin(); it != _refMap.cend(); ++it) {
+      if (it->second.data > 0) {
+        _GET_(_beginMap, it->first) = now;
+      }
+    }
+    for (time_map::const_iterator it = _costMap.cbegin(); it != _costMap.cend(); ++it) {
+      it->second.data = 0;
+    }
+    _allocCnt = _allocBytes = _freeCnt = 0;
+    _cpuCnt = _cpuCost = _cpuWall = 0;
+    _perfCnt = 0;
+    for (size_t i = 0; i < EZPP_PERF_MAX; ++i) {
+      _perf[i] = 0;
+    }
+    _ruCnt = 0;
+    for (size_t i = 0; i < EZPP_RUSAGE_MAX; ++i) {
+      _ru[i] = 0;
+    }
+    rusage_map* ru = _ruMap;
+    if (ru) {
+      for (rusage_map::const_iterator it = ru->cbegin(); it != ru->cend(); ++it) {
+        for (size_t i = 0; i < EZPP_RUSAGE_MAX; ++i) {
+          it->second.values[i] = 0;
+        }
+      }
+    }
+    _objs.reset();
+    _selfCost = _childCost = _suspendCost = _queueCost = 0;
+    _duration.reset();
+    window* w = _window;
+    if (w) {
+      w->reset();
+    }
+    for (size_t i = 0; i < EZPP_COUNTER_MAX; ++i) {
+      _counters[i] = 0;
+    }
+    _overCnt = 0;
+    slow_log* slow = _slow;
+    if (slow) {
+      slow->reset();
+    }
+    edge_map* edges = _edgeMap;
+    if (edges) {
+      for (edge_map::const_iterator it = edges->cbegin(); it != edges->cend(); ++it) {
+        it->second.callCnt = 0;
+        it->second.totalCost = 0;
+      }
+    }
+  }
+
+  #undef _GET_
+
+  // public
+  EZPP_INLINE void
+  node::output(FILE* fp) {
+    text_reporter::output(fp, site_view(this));
+  }
+
+  // public
+  EZPP_INLINE std::vector<slow_log::entry>
+  site_view::slowest() const {
+    slow_log* m = _n->_slow;
+    return m ? m->top() : std::vector<slow_log::entry>();
+  }
+
+  // public
+  EZPP_INLINE bool
+  site_view::rusage(size_t key, int64_t values[EZPP_RUSAGE_MAX]) const {
+    node::rusage_map* m = _n->_ruMap;
+    if (!m) {
+      return false;
+    }
+    node::rusage_map::const_iterator it = m->find(key);
+    if (it == m->cend()) {
+      return false;
+    }
+    for (size_t i = 0; i < EZPP_RUSAGE_MAX; ++i) {
+      values[i] = it->second.values[i];
+    }
+    return true;
+  }
+
+  // public
+  EZPP_INLINE site_view::caller_range
+  site_view::callers() const {
+    // sites never nested in another one have no map
+    static const node::edge_map none(1);
+    const node::edge_map* m = _n->_edgeMap;
+    return caller_range(m ? *m : none);
+  }
+
+  // public
+  EZPP_INLINE int64_t
+  site_view::samples(std::vector<sampled_func>& funcs) const {
+    return inst().sampled(_n->_id, funcs);
+  }
+
+  // public
+  EZPP_INLINE std::vector<lock_site*>
+  view::locks() const {
+    std::vector<lock_site*> array;
+    {
+      detail::spin_guard guard(_pp._lockLock);
+      for (ezpp::lock_map::iterator it = _pp._lockMap.begin(); it != _pp._lockMap.end(); ++it) {
+        if (it->second->acquireCnt()) {
+          array.push_back(it->second);
+        }
+      }
+    }
+    std::sort(array.begin(), array.end(), detail::WaitTimeSort);
+    return array;
+  }
+
+  // public
+  EZPP_INLINE void
+  text_reporter::report(const view& v) {
+    std::vector<lock_site*> locks = v.locks();
+    view::site_range range = v.sites();
+    std::vector<site_view> sites;
+    for (view::site_range::iterator it = range.begin(); it != range.end(); ++it) {
+      site_view s = *it;
+      // not called since the last reset
+      if (s.callCnt() || s.openCnt()) {
+        sites.push_back(s);
+      }
+    }
+    if (sites.empty() && locks.empty()) {
+      return;
+    }
+    fprintf(_fp, "========== Easy Performance Profiler Report ==========\r\n");
+
+    unsigned int option = v.options();
+    if ((option & EZPP_OPT_SORT_BY_NAME) || !(option & EZPP_OPT_SORT)) {
+      outputSites(_fp, sites, detail::NameSort, "Sort By Name");
+    }
+    if (option & EZPP_OPT_SORT_BY_CALL) {
+      outputSites(_fp, sites, detail::CallCntSort, "Sort By Call");
+    }
+    if (option & EZPP_OPT_SORT_BY_COST) {
+      outputSites(_fp, sites, detail::CostTimeSort, "Sort By Cost");
+    }
+
+    if (!locks.empty()) {
+      fprintf(_fp, "\r\n     [Lock Contention]\r\n\r\n");
+      for (unsigned i = 0; i < locks.size(); ++i) {
+        fprintf(_fp, "No.%u\r\n", i + 1);
+        locks[i]->output(_fp);
+      }
+    }
+
+    if (v.allocCnt() || v.freeCnt()) {
+      fprintf(_fp, "====== [Alloc Outside Scopes] %" PRId64 " allocs, ", v.allocCnt());
+      ezpp::outputBytes(_fp, v.allocBytes());
+      fprintf(_fp, ", %" PRId64 " frees ======\r\n", v.freeCnt());
+    }
+    std::vector<slow_log::entry> slow = v.slowest();
+    if (!slow.empty()) {
+      fprintf(_fp, "\r\n     [Slowest Over Budget]\r\n\r\n");
+      for (size_t i = 0; i < slow.size(); ++i) {
+        outputSlow(_fp, slow[i], true);
+      }
+      fprintf(_fp, "\r\n");
+    }
+    outputCounters(_fp, v);
+    fprintf(_fp, "====== [Total Time Elapsed] ");
+    ezpp::outputTime(_fp, v.elapsed());
+    time_t timep;
+    time(&timep);
+    char tmp[64];
+    strftime(tmp, sizeof(tmp), "%Y-%m-%d %H:%M:%S", localtime(&timep));
+    fprintf(_fp, " ======\r\n====== [Generate Date] %s ======\r\n", tmp);
+  }
+
+  // protected static
+  EZPP_INLINE void
+  text_reporter::outputSites(FILE* fp, std::vector<site_view>& sites, bool (*sort)(const site_view&, const site_view&), const char* title) {
+    if (sites.empty()) {
+      return;
+    }
+    std::sort(sites.begin(), sites.end(), sort);
+    fprintf(fp, "\r\n     [%s]\r\n\r\n", title);
+    for (unsigned i = 0; i < sites.size(); ++i) {
+      fprintf(fp, "No.%u\r\n", i + 1);
+      output(fp, sites[i]);
+    }
+  }
+
+  // protected static
+  EZPP_INLINE void
+  text_reporter::outputCounters(FILE* fp, const view& v) {
+    double seconds = (double)v.elapsed() / 1000000;
+    for (int i = 0; i < v.counterCnt(); ++i) {
+      int64_t total = v.counter(i);
+      if (!total) {
+        continue;
+      }
+      fprintf(fp, "====== [Count] %s ", v.counterName(i).c_str());
+      ezpp::outputCount(fp, (double)total);
+      if (seconds > 0) {
+        fprintf(fp, ", ");
+        ezpp::outputCount(fp, total / seconds);
+        fprintf(fp, "/s");
+      }
+      fprintf(fp, " ======\r\n");
+    }
+  }
+
+  // protected static, duration, time, thread, tag and the scopes of a call over budget
+  EZPP_INLINE void
+  text_reporter::outputSlow(FILE* fp, const slow_log::entry& e, bool named) {
+    ezpp& pp = inst();
+    fprintf(fp, "    ");
+    ezpp::outputTime(fp, e.duration);
+    if (named) {
+      const site* s = pp.findSite(e.site);
+      fprintf(fp, " %s", s ? s->name().c_str() : "?");
+      if (s && !s->ext().empty()) {
+        fprintf(fp, " \"%s\"", s->ext().c_str());
+      }
+    }
+    fprintf(fp, " at +");
+    ezpp::outputTime(fp, e.when - pp._begin);
+    if (e.thread & EZPP_CONTEXT_TAG) {
+      fprintf(fp, " (Context : %llu)", e.thread & ~(unsigned long long)EZPP_CONTEXT_TAG);
+    }
+    else {
+      fprintf(fp, " (Thread ID : %llu)", e.thread);
+    }
+    if (e.tag[0]) {
+      fprintf(fp, " [%s]", e.tag);
+    }
+    if (e.depth) {
+      fprintf(fp, " in ");
+      for (int i = 0; i < e.depth; ++i) {
+        const site* s = pp.findSite(e.stack[i]);
+        fprintf(fp, i ? " > %s" : "%s", s ? s->name().c_str() : "?");
+      }
+    }
+    fprintf(fp, "\r\n");
+  }
 
-      if ((_flags & EZPP_NODE_DIRECT_OUTPUT)) {
-        output(stdout);
-        inst().removeDoNode(_id);
-        delete this;
-      }
-      else if (_releaseUntilEnd)
-        delete this;
+  // protected static
+  EZPP_INLINE void
+  text_reporter::outputKey(FILE* fp, const site_view& s, size_t key) {
+    if (s.flags() & EZPP_NODE_CLS) {
+      fprintf(fp, "(Object : 0x%llx)", (unsigned long long)key);
+    }
+    else if (key & EZPP_CONTEXT_TAG) {
+      fprintf(fp, "(Context : %llu)", (unsigned long long)(key & ~EZPP_CONTEXT_TAG));
+    }
+    else {
+      fprintf(fp, "(Thread ID : %llu)", (unsigned long long)key);
     }
   }
 
-  #undef _GET_
+  // protected static
+  EZPP_INLINE void
+  text_reporter::outputRusage(FILE* fp, const site_view& s, size_t key) {
+    int64_t ru[EZPP_RUSAGE_MAX];
+    if (s.rusage(key, ru)) {
+      fprintf(fp, " [cs %" PRId64 "/%" PRId64 ", faults %" PRId64 "/%" PRId64 "]", ru[0], ru[1], ru[2], ru[3]);
+    }
+  }
 
-  // public
-  void
-  node::output(FILE* fp) {
+  // public static
+  EZPP_INLINE void
+  text_reporter::output(FILE* fp, const site_view& s) {
     fprintf(fp, "[Name] ");
-    if (_line) {
-      fprintf(fp, "%s (%s:%d", _name.c_str(), _file, _line);
-      if (_endLine) {
-        fprintf(fp, "~%d", _endLine);
+    if (s.line()) {
+      fprintf(fp, "%s (%s:%d", s.name().c_str(), s.file(), s.line());
+      if (s.endLine()) {
+        fprintf(fp, "~%d", s.endLine());
       }
       fprintf(fp, ")");
     }
-    if (!_ext.empty()) {
-      fprintf(fp, " \"%s\"", _ext.c_str());
+    else {
+      // instrumented functions, named by their symbol
+      fprintf(fp, "%s", s.name().c_str());
+    }
+    if (!s.ext().empty()) {
+      fprintf(fp, " \"%s\"", s.ext().c_str());
     }
     fprintf(fp, "\r\n");
-    if (_totalRefCnt)
+    if (s.openCnt())
       fprintf(fp, "Warning: unbalance detected! Mismatch or haven't ended yet!\r\n");
     fprintf(fp, "[Time] ");
-    ezpp::outputTime(fp, _totalCost);
-    if (_totalRefCnt) {
+    ezpp::outputTime(fp, s.totalCost());
+    if (s.openCnt()) {
       fprintf(fp, " (+ ");
-      ezpp::outputTime(fp, time_now() - _start);
+      ezpp::outputTime(fp, time_now() - s.openSince());
       fprintf(fp, ")");
     }
-    time_map::const_iterator it = _costMap.cbegin();
-    if (it != _costMap.cend()) {
-      if (++it == _costMap.cend()) {
-        fprintf(fp, (_flags & EZPP_NODE_CLS) ? "   (Object : 0x%0x)" : "   (Thread ID : %u)",
-          (unsigned)_costMap.cbegin()->first);
+    site_view::thread_range threads = s.threads();
+    site_view::thread_range::iterator it = threads.begin();
+    if (it != threads.end()) {
+      if (++it == threads.end()) {
+        fprintf(fp, "   ");
+        outputKey(fp, s, (*threads.begin()).key);
+        outputRusage(fp, s, (*threads.begin()).key);
         fprintf(fp, "\r\n");
       }
       else {
         fprintf(fp, "\r\n");
         int64_t total = 0;
         size_t costTimeSize = 0;
-        for (time_map::const_iterator it = _costMap.cbegin(); it != _costMap.cend(); ++it) {
-          fprintf(fp, (_flags & EZPP_NODE_CLS) ? "    (Object : 0x%0x) " :"    (Thread ID : %u) ",
-            (unsigned)it->first);
-          ezpp::outputTime(fp, it->second.data);
+        for (site_view::thread_range::iterator it = threads.begin(); it != threads.end(); ++it) {
+          thread_cost t = *it;
+          fprintf(fp, "    ");
+          outputKey(fp, s, t.key);
+          fprintf(fp, " ");
+          ezpp::outputTime(fp, t.cost);
+          outputRusage(fp, s, t.key);
           fprintf(fp, "\r\n");
-          total += it->second.data;
+          total += t.cost;
           ++costTimeSize;
         }
         fprintf(fp, "  [Avg] ");
@@ -1175,21 +5778,472 @@ namespace ezpp {
         fprintf(fp, "\r\n");
       }
     }
-    fprintf(fp, "[Call] %" PRId64 "\r\n\r\n", _callCnt.load());
+    else {
+      fprintf(fp, "\r\n");
+    }
+    if (s.childCost()) {
+      fprintf(fp, "[Self] ");
+      ezpp::outputTime(fp, s.selfCost());
+      fprintf(fp, ", nested scopes ");
+      ezpp::outputTime(fp, s.childCost());
+      fprintf(fp, "\r\n");
+    }
+    if (s.queueCost()) {
+      fprintf(fp, "[Queued] ");
+      ezpp::outputTime(fp, s.queueCost());
+      fprintf(fp, ", running ");
+      ezpp::outputTime(fp, s.selfCost() - s.queueCost());
+      fprintf(fp, "\r\n");
+    }
+    if (s.suspendCost()) {
+      fprintf(fp, "[Suspended] ");
+      ezpp::outputTime(fp, s.suspendCost());
+      fprintf(fp, ", running ");
+      ezpp::outputTime(fp, s.selfCost() + s.childCost());
+      fprintf(fp, "\r\n");
+    }
+    const histogram& duration = s.duration();
+    if (duration.count() > 1) {
+      fprintf(fp, "[Latency] p50 <= ");
+      ezpp::outputTime(fp, duration.percentile(0.5));
+      fprintf(fp, ", p90 <= ");
+      ezpp::outputTime(fp, duration.percentile(0.9));
+      fprintf(fp, ", p99 <= ");
+      ezpp::outputTime(fp, duration.percentile(0.99));
+      fprintf(fp, "\r\n");
+    }
+    // windows reaching back before the site was created repeat the shorter one
+    static const int windows[] = { 1, 10, 60 };
+    int64_t now = time_now(), span = 0;
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+      window::stat st;
+      s.recent(windows[i], st, now);
+      if (st.span == span) {
+        break;
+      }
+      span = st.span;
+      if (!st.callCnt) {
+        continue;
+      }
+      fprintf(fp, "[Last %ds] %" PRId64 " calls, %.2f/s, avg ", windows[i], st.callCnt, st.rate());
+      ezpp::outputTime(fp, st.mean());
+      fprintf(fp, ", p50 <= ");
+      ezpp::outputTime(fp, st.percentile(0.5));
+      fprintf(fp, ", p99 <= ");
+      ezpp::outputTime(fp, st.percentile(0.99));
+      fprintf(fp, "\r\n");
+    }
+    int64_t callCnt = s.callCnt();
+    if (s.overCnt()) {
+      fprintf(fp, "[Budget] ");
+      ezpp::outputTime(fp, s.budget());
+      fprintf(fp, ", %" PRId64 " over (%.1f%%)\r\n", s.overCnt(), callCnt ? (double)s.overCnt() * 100 / callCnt : 0.0);
+      std::vector<slow_log::entry> top = s.slowest();
+      if (!top.empty()) {
+        fprintf(fp, "  [Slowest]\r\n");
+        for (size_t i = 0; i < top.size(); ++i) {
+          outputSlow(fp, top[i], false);
+        }
+      }
+    }
+    std::vector<sampled_func> funcs;
+    int64_t samples = s.samples(funcs);
+    if (samples) {
+      fprintf(fp, "[Samples] %" PRId64 ", hottest inside\r\n", samples);
+      for (size_t i = 0; i < funcs.size() && i < EZPP_SAMPLE_TOP; ++i) {
+        fprintf(fp, "    %5.1f%% %s\r\n", (double)funcs[i].cnt * 100 / samples, funcs[i].name.c_str());
+      }
+    }
+    if (s.allocCnt() || s.freeCnt()) {
+      fprintf(fp, "[Alloc] %" PRId64 " allocs, ", s.allocCnt());
+      ezpp::outputBytes(fp, s.allocBytes());
+      fprintf(fp, ", ");
+      ezpp::outputBytes(fp, callCnt ? s.allocBytes() / callCnt : 0);
+      fprintf(fp, "/call, %" PRId64 " frees\r\n", s.freeCnt());
+    }
+    ezpp& pp = inst();
+    for (int i = 0; i < pp._counterCnt; ++i) {
+      int64_t total = s.counter(i);
+      if (!total) {
+        continue;
+      }
+      // rates per second of time in the scope, and of cpu time if measured
+      fprintf(fp, "[Count] %s ", pp._counterNames[i].c_str());
+      ezpp::outputCount(fp, (double)total);
+      fprintf(fp, ", ");
+      ezpp::outputCount(fp, callCnt ? (double)total / callCnt : 0);
+      fprintf(fp, "/call");
+      int64_t wall = s.selfCost() + s.childCost();
+      if (wall > 0) {
+        fprintf(fp, ", ");
+        ezpp::outputCount(fp, (double)total * 1000000 / wall);
+        fprintf(fp, "/s");
+      }
+      if (s.cpuCost() > 0) {
+        fprintf(fp, ", ");
+        ezpp::outputCount(fp, (double)total * 1000000 / s.cpuCost());
+        fprintf(fp, "/cpu s");
+      }
+      fprintf(fp, "\r\n");
+    }
+    if (s.cpuCnt()) {
+      int64_t cpu = s.cpuCost(), wall = s.cpuWall();
+      int64_t offCpu = wall > cpu ? wall - cpu : 0;
+      fprintf(fp, "[CPU] ");
+      ezpp::outputTime(fp, cpu);
+      fprintf(fp, " on cpu, ");
+      ezpp::outputTime(fp, offCpu);
+      fprintf(fp, " off cpu (%.1f%%)\r\n", wall ? (double)offCpu * 100 / wall : 0.0);
+    }
+    if (s.ruCnt()) {
+      double calls = (double)s.ruCnt();
+      fprintf(fp, "[Rusage] %" PRId64 " voluntary cs (%.2f/call), %" PRId64 " involuntary cs (%.2f/call), "
+        "%" PRId64 " minor faults (%.2f/call), %" PRId64 " major faults (%.2f/call)\r\n",
+        s.rusage(0), s.rusage(0) / calls, s.rusage(1), s.rusage(1) / calls,
+        s.rusage(2), s.rusage(2) / calls, s.rusage(3), s.rusage(3) / calls);
+    }
+    if (s.perfCnt()) {
+      double calls = (double)s.perfCnt();
+      if (s.perfKind() == EZPP_PERF_HW) {
+        fprintf(fp, "[PMU] IPC %.2f, %.0f cycles/call, %.1f cache-misses/call, %.1f branch-misses/call\r\n",
+          s.perf(0) ? (double)s.perf(1) / s.perf(0) : 0.0, s.perf(0) / calls, s.perf(2) / calls, s.perf(3) / calls);
+      }
+      else {
+        fprintf(fp, "[PMU] %.2f context-switches/call, %.2f page-faults/call (software events)\r\n",
+          s.perf(0) / calls, s.perf(1) / calls);
+      }
+    }
+    if (s.aggregated()) {
+      const obj_tracker& objs = s.objects();
+      int64_t elapsed = time_now() - s.created();
+      fprintf(fp, "[Object] live %" PRId64 ", peak %" PRId64 ", destroyed %" PRId64 ", %.2f/sec\r\n",
+        objs.live(), objs.peak(), objs.dead(), elapsed > 0 ? (double)callCnt * 1000000 / elapsed : 0.0);
+      if (objs.dead()) {
+        fprintf(fp, "[Lifetime] avg ");
+        ezpp::outputTime(fp, objs.lifeSum() / objs.dead());
+        fprintf(fp, ", p99 < ");
+        ezpp::outputTime(fp, objs.lifeHist().percentile(0.99));
+        fprintf(fp, ", max ");
+        ezpp::outputTime(fp, objs.lifeMax());
+        fprintf(fp, "\r\n");
+        for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+          if (objs.lifeHist().bucketCnt(i)) {
+            fprintf(fp, "    [");
+            ezpp::outputTime(fp, histogram::bucketLower(i));
+            fprintf(fp, " ~ ");
+            ezpp::outputTime(fp, histogram::bucketUpper(i));
+            fprintf(fp, ") %" PRId64 "\r\n", objs.lifeHist().bucketCnt(i));
+          }
+        }
+        std::vector<obj_tracker::entry> top = objs.top();
+        fprintf(fp, "  [Longest]\r\n");
+        for (size_t i = 0; i < top.size(); ++i) {
+          fprintf(fp, "    (Object : %p) ", (void*)top[i].obj);
+          ezpp::outputTime(fp, top[i].lifetime);
+          fprintf(fp, "\r\n");
+        }
+      }
+    }
+    fprintf(fp, "[Call] %" PRId64 "\r\n\r\n", callCnt);
+  }
+
+  // public
+  EZPP_INLINE void
+  json_reporter::report(const view& v) {
+    // ids and keys are full 64 bit, as hex strings like ezpp-report, doubles would round them
+    fprintf(_fp, "{\"elapsed\":%" PRId64 ",\"sites\":[", v.elapsed());
+    view::site_range sites = v.sites();
+    bool first = true;
+    for (view::site_range::iterator it = sites.begin(); it != sites.end(); ++it) {
+      site_view s = *it;
+      if (!s.callCnt() && !s.openCnt()) {
+        continue;
+      }
+      fprintf(_fp, first ? "\n{\"id\":\"%llx\",\"name\":" : ",\n{\"id\":\"%llx\",\"name\":", (unsigned long long)s.id());
+      first = false;
+      outputString(_fp, s.name());
+      fprintf(_fp, ",\"file\":");
+      outputString(_fp, s.file());
+      fprintf(_fp, ",\"line\":%d,\"ext\":", s.line());
+      outputString(_fp, s.ext());
+      fprintf(_fp, ",\"calls\":%" PRId64 ",\"total\":%" PRId64 ",\"self\":%" PRId64 ",\"child\":%" PRId64
+        ",\"cpu\":%" PRId64 ",\"allocs\":%" PRId64 ",\"allocBytes\":%" PRId64 ",\"overBudget\":%" PRId64,
+        s.callCnt(), s.totalCost(), s.selfCost(), s.childCost(), s.cpuCost(), s.allocCnt(), s.allocBytes(), s.overCnt());
+      const histogram& duration = s.duration();
+      fprintf(_fp, ",\"p50\":%" PRId64 ",\"p90\":%" PRId64 ",\"p99\":%" PRId64 ",\"duration\":[",
+        duration.percentile(0.5), duration.percentile(0.9), duration.percentile(0.99));
+      for (size_t i = 0; i < EZPP_HIST_BUCKETS; ++i) {
+        fprintf(_fp, i ? ",%" PRId64 : "%" PRId64, duration.bucketCnt(i));
+      }
+      static const int windows[] = { 1, 10, 60 };
+      fprintf(_fp, "],\"recent\":{");
+      for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+        window::stat st;
+        s.recent(windows[i], st, v.now());
+        fprintf(_fp, "%s\"%d\":{\"calls\":%" PRId64 ",\"rate\":%.2f,\"mean\":%" PRId64 ",\"p99\":%" PRId64 "}",
+          i ? "," : "", windows[i], st.callCnt, st.rate(), st.mean(), st.percentile(0.99));
+      }
+      fprintf(_fp, "},\"counters\":{");
+      for (int i = 0, n = 0; i < v.counterCnt(); ++i) {
+        if (s.counter(i)) {
+          fprintf(_fp, n++ ? "," : "");
+          outputString(_fp, v.counterName(i));
+          fprintf(_fp, ":%" PRId64, s.counter(i));
+        }
+      }
+      fprintf(_fp, "},\"threads\":[");
+      site_view::thread_range threads = s.threads();
+      for (site_view::thread_range::iterator tit = threads.begin(); tit != threads.end(); ++tit) {
+        thread_cost t = *tit;
+        fprintf(_fp, "%s{\"key\":\"%llx\",\"cost\":%" PRId64 "}", tit == threads.begin() ? "" : ",", (unsigned long long)t.key, t.cost);
+      }
+      fprintf(_fp, "],\"callers\":[");
+      site_view::caller_range callers = s.callers();
+      for (site_view::caller_range::iterator cit = callers.begin(); cit != callers.end(); ++cit) {
+        caller_cost c = *cit;
+        fprintf(_fp, "%s{\"parent\":\"%llx\",\"calls\":%" PRId64 ",\"total\":%" PRId64 "}",
+          cit == callers.begin() ? "" : ",", (unsigned long long)c.parent, c.callCnt, c.totalCost);
+      }
+      std::vector<sampled_func> funcs;
+      fprintf(_fp, "],\"samples\":%" PRId64 ",\"hottest\":[", s.samples(funcs));
+      for (size_t i = 0; i < funcs.size() && i < EZPP_SAMPLE_TOP; ++i) {
+        fprintf(_fp, i ? ",{\"name\":" : "{\"name\":");
+        outputString(_fp, funcs[i].name);
+        fprintf(_fp, ",\"samples\":%" PRId64 "}", funcs[i].cnt);
+      }
+      fprintf(_fp, "]}");
+    }
+    fprintf(_fp, "\n],\"counters\":{");
+    for (int i = 0, n = 0; i < v.counterCnt(); ++i) {
+      int64_t total = v.counter(i);
+      if (total) {
+        fprintf(_fp, n++ ? "," : "");
+        outputString(_fp, v.counterName(i));
+        fprintf(_fp, ":%" PRId64, total);
+      }
+    }
+    fprintf(_fp, "}}\n");
+  }
+
+  // protected static
+  EZPP_INLINE void
+  json_reporter::outputString(FILE* fp, const std::string& s) {
+    fputc('"', fp);
+    for (size_t i = 0; i < s.size(); ++i) {
+      unsigned char c = (unsigned char)s[i];
+      if (c == '"' || c == '\\') {
+        fputc('\\', fp);
+        fputc(c, fp);
+      }
+      else if (c < 0x20) {
+        fprintf(fp, "\\u%04x", c);
+      }
+      else {
+        fputc(c, fp);
+      }
+    }
+    fputc('"', fp);
+  }
+
+  // public
+  EZPP_INLINE void
+  lock_site::output(FILE* fp) {
+    fprintf(fp, "[Lock] %s", _name.c_str());
+    if (_line) {
+      fprintf(fp, " (%s:%d)", _file, _line);
+    }
+    if (!_ext.empty()) {
+      fprintf(fp, " \"%s\"", _ext.c_str());
+    }
+    fprintf(fp, "\r\n[Wait] ");
+    ezpp::outputTime(fp, _waitTime);
+    if (_contendedCnt) {
+      fprintf(fp, " (avg ");
+      ezpp::outputTime(fp, _waitTime / _contendedCnt);
+      fprintf(fp, ", max ");
+      ezpp::outputTime(fp, _waitMax);
+      fprintf(fp, ")");
+    }
+    if (_holdCnt) {
+      fprintf(fp, "\r\n[Hold] ");
+      ezpp::outputTime(fp, _holdTime);
+      fprintf(fp, " (avg ");
+      ezpp::outputTime(fp, _holdTime / _holdCnt);
+      fprintf(fp, ")");
+    }
+    fprintf(fp, "\r\n[Acquire] %" PRId64 ", contended %" PRId64 " (%.1f%%)\r\n\r\n",
+      _acquireCnt.load(), _contendedCnt.load(), _acquireCnt ? (double)_contendedCnt * 100 / _acquireCnt : 0.0);
+  }
+
+  // public static
+  EZPP_INLINE std::string
+  shm::segment::name(int pid) {
+    char buf[32];
+    sprintf(buf, EZPP_SHM_PREFIX "%d", pid);
+    return buf;
+  }
+
+  // public
+  EZPP_INLINE bool
+  shm::segment::create() {
+  #ifdef _WIN32
+    return false;
+  #else
+    close();
+    int pid = (int)getpid();
+    std::string file = name(pid);
+    size_t size = sizeof(header) + sizeof(record) * EZPP_NODE_MAX;
+    // a segment left behind by a crashed process of the same pid is replaced
+    shm_unlink(file.c_str());
+    int fd = shm_open(file.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    void* p = MAP_FAILED;
+    if (!ftruncate(fd, (off_t)size)) {
+      p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      shm_unlink(file.c_str());
+      return false;
+    }
+    // fresh pages are zeroed
+    _hdr = (header*)p;
+    _hdr->version = EZPP_SHM_VERSION;
+    _hdr->headerSize = sizeof(header);
+    _hdr->recordSize = sizeof(record);
+    _hdr->recordMax = EZPP_NODE_MAX;
+    _hdr->recordCnt = 0;
+    _hdr->pid = pid;
+    _hdr->started = time_now();
+    _hdr->magic.store(EZPP_SHM_MAGIC, std::memory_order_release);
+    _size = size;
+    _owner = true;
+    _pid = pid;
+    return true;
+  #endif
+  }
+
+  // public
+  EZPP_INLINE bool
+  shm::segment::open(int pid) {
+  #ifdef _WIN32
+    (void)pid;
+    return false;
+  #else
+    return attach(shm_open(name(pid).c_str(), O_RDONLY, 0));
+  #endif
+  }
+
+  // public
+  EZPP_INLINE bool
+  shm::segment::load(const std::string& file) {
+  #ifdef _WIN32
+    (void)file;
+    return false;
+  #else
+    return attach(::open(file.c_str(), O_RDONLY));
+  #endif
+  }
+
+  // private, takes over fd
+  EZPP_INLINE bool
+  shm::segment::attach(int fd) {
+  #ifdef _WIN32
+    (void)fd;
+    return false;
+  #else
+    close();
+    if (fd < 0) {
+      return false;
+    }
+    struct ::stat st;
+    void* p = MAP_FAILED;
+    if (!fstat(fd, &st) && (size_t)st.st_size >= sizeof(header)) {
+      p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    header* hdr = (header*)p;
+    if (hdr->magic.load(std::memory_order_acquire) != EZPP_SHM_MAGIC || hdr->version != EZPP_SHM_VERSION
+      || hdr->headerSize + (size_t)hdr->recordSize * hdr->recordMax > (size_t)st.st_size) {
+      munmap(p, (size_t)st.st_size);
+      return false;
+    }
+    _hdr = hdr;
+    _size = (size_t)st.st_size;
+    _owner = false;
+    _pid = (int)hdr->pid;
+    return true;
+  #endif
+  }
+
+  // public
+  EZPP_INLINE void
+  shm::segment::close() {
+  #ifndef _WIN32
+    if (_hdr) {
+      munmap(_hdr, _size);
+      if (_owner) {
+        shm_unlink(name(_pid).c_str());
+      }
+    }
+  #endif
+    _hdr = 0;
+    _size = 0;
+    _owner = false;
+  }
+
+  // public
+  EZPP_INLINE void
+  shm::segment::detach() {
+    _owner = false;
+    close();
+  }
+
+  // public
+  EZPP_INLINE shm::record*
+  shm::segment::alloc(size_t id, const char* file, int line, const std::string& name, const std::string& ext) {
+    if (!_owner || _hdr->recordCnt >= _hdr->recordMax) {
+      return 0;
+    }
+    // writers are serialized by the caller, readers only look below recordCnt
+    unsigned int i = _hdr->recordCnt;
+    record* r = (record*)((char*)_hdr + _hdr->headerSize + (size_t)i * _hdr->recordSize);
+    r->line = line;
+    r->data.id = (int64_t)id;
+    strncpy(r->file, file ? file : "", EZPP_SHM_FILE_MAX - 1);
+    strncpy(r->name, name.c_str(), EZPP_SHM_NAME_MAX - 1);
+    strncpy(r->ext, ext.c_str(), EZPP_SHM_EXT_MAX - 1);
+    _hdr->recordCnt.store(i + 1, std::memory_order_release);
+    return r;
   }
+
+#endif // _EZPP_DEFINITIONS
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-#define _EZPP_SUB_CHECK(expression)            if (::ezpp::inst().enabled()) { static const size_t id = ::ezpp::ezpp::gen_id(); expression; }
+#define _EZPP_SUB_CHECK(name, desc, expression) \
+  if (::ezpp::inst().enabled()) {              \
+    static ::ezpp::site _ezpp_site(_EZPP_SITE_HASH, __FILE__, __LINE__, name, desc); \
+    if (LIKELY(_ezpp_site.enabled())) { expression; } \
+  }
 
 #define _EZPP_AUX_BASE(sign, flags, desc)      \
   ::ezpp::node_aux _ezpp_a_##sign;             \
-  _EZPP_SUB_CHECK(_ezpp_a_##sign.set(::ezpp::ezpp::create(id, EZPP_THREAD_ID, EZPP_NODE_AUTO_START | flags, __FILE__, __LINE__, __FUNCTION__, desc), EZPP_THREAD_ID))
+  if (::ezpp::inst().enabled()) {              \
+    static ::ezpp::site _ezpp_site(_EZPP_SITE_HASH, __FILE__, __LINE__, __FUNCTION__, desc); \
+    if (LIKELY(_ezpp_site.enabled())) { _ezpp_a_##sign.set(::ezpp::ezpp::create(_ezpp_site, EZPP_THREAD_ID, EZPP_NODE_AUTO_START | flags), EZPP_THREAD_ID); } \
+    else { _ezpp_a_##sign.unframed(); }        \
+  }
 
 #define _EZPP_NO_AUX_BEGIN_BASE(sign, flags, desc) \
   ::ezpp::node *_ezpp_na_##sign##_ = 0;        \
-  _EZPP_SUB_CHECK(_ezpp_na_##sign##_ = ::ezpp::ezpp::create(id, EZPP_THREAD_ID, EZPP_NODE_AUTO_START | flags, __FILE__, __LINE__, __FUNCTION__, desc))
+  _EZPP_SUB_CHECK(__FUNCTION__, desc, _ezpp_na_##sign##_ = ::ezpp::ezpp::create(_ezpp_site, EZPP_THREAD_ID, EZPP_NODE_AUTO_START | flags))
 
 #define _EZPP_NO_AUX_END_BASE(sign)            \
   if (_ezpp_na_##sign##_) {                    \
@@ -1197,17 +6251,40 @@ namespace ezpp {
     _ezpp_na_##sign##_->end(EZPP_THREAD_ID);   \
   }
 
+// the line goes into the names, so that one scope can guard several mutexes
+#define _EZPP_LOCK_BASE(m, desc)               _EZPP_LOCK_LINE(m, desc, __LINE__)
+#define _EZPP_LOCK_LINE(m, desc, line)         _EZPP_LOCK_SIGN(m, desc, line)
+
+#define _EZPP_LOCK_SIGN(m, desc, sign)         \
+  ::ezpp::lock_site *_ezpp_ls_##sign##_ = 0;   \
+  _EZPP_SUB_CHECK(__FUNCTION__, desc, static ::ezpp::lock_site* const ls = ::ezpp::inst().lockSite(__FILE__, __LINE__, __FUNCTION__, desc); _ezpp_ls_##sign##_ = ls) \
+  ::ezpp::lock_guard _ezpp_lock_##sign##_(m, _ezpp_ls_##sign##_)
+
+#define _EZPP_COUNTER_BASE(name, n, fn)        \
+  if (::ezpp::inst().enabled()) {              \
+    static const int _ezpp_counter = ::ezpp::inst().counterId(name); \
+    fn(_ezpp_counter, n);                      \
+  }
+
+#define _EZPP_BUDGET_BASE(ms)                  \
+  if (::ezpp::inst().enabled()) {              \
+    ::ezpp::detail::budget((int64_t)((ms) * 1000)); \
+  }
+
+#define _EZPP_SPAN_START_BASE(s, desc)         \
+  _EZPP_SUB_CHECK(__FUNCTION__, desc, { ::ezpp::detail::epoch_guard _ezpp_g; (s).start(::ezpp::ezpp::create(_ezpp_site, 0, EZPP_NODE_SPAN)); })
+
 #define _EZPP_CLS_REGISTER_BASE(sign)          \
   protected:                                   \
-    ::ezpp::node_aux _ezpp_cls_##sign;         \
+    ::ezpp::cls_aux _ezpp_cls_##sign;          \
   public:                                      \
 
 #define _EZPP_CLS_INIT_BASE(sign, flags, desc) \
-  _EZPP_SUB_CHECK(_ezpp_cls_##sign.set(::ezpp::ezpp::create(id, (size_t)this, EZPP_NODE_AUTO_START | EZPP_NODE_CLS | flags, __FILE__, __LINE__, typeid(*this).name(), desc), (int64_t)this))
+  _EZPP_SUB_CHECK(typeid(*this).name(), desc, _ezpp_cls_##sign.set(::ezpp::ezpp::create(_ezpp_site, (size_t)this, EZPP_NODE_AUTO_START | EZPP_NODE_CLS | flags), (size_t)this))
 
 #define _EZPP_ILDO_DECL_BASE(sign, flags, desc)\
   ::ezpp::node *_ezpp_ildo_##sign##_ = 0;      \
-  _EZPP_SUB_CHECK(_ezpp_ildo_##sign##_ = ::ezpp::ezpp::create(id, EZPP_THREAD_ID, EZPP_NODE_DIRECT_OUTPUT | flags, __FILE__, __LINE__, __FUNCTION__, desc))
+  _EZPP_SUB_CHECK(__FUNCTION__, desc, _ezpp_ildo_##sign##_ = ::ezpp::ezpp::create(_ezpp_site, EZPP_THREAD_ID, EZPP_NODE_DIRECT_OUTPUT | flags))
 
 #define _EZPP_ILDO_BASE(sign)                  \
   ::ezpp::node_aux _ezpp_a_ildo_##sign##_(_ezpp_ildo_##sign##_, EZPP_THREAD_ID);\
@@ -1218,3 +6295,289 @@ namespace ezpp {
 
 #define _EZPP_ILDO_END_BASE(sign)              \
   if (_ezpp_ildo_##sign##_) _ezpp_ildo_##sign##_->end(EZPP_THREAD_ID);
+
+//////////////////////////////////////////////////////////////////////////
+
+// define EZPP_ALLOC_HOOK (operator new/delete) or EZPP_ALLOC_HOOK_MALLOC (malloc/free, glibc only)
+// before including in exactly one translation unit to charge heap allocations to the innermost scope
+
+#if __cplusplus >= 201103L
+  #define _EZPP_THROW_BAD_ALLOC
+  #define _EZPP_NOEXCEPT                       noexcept
+#else
+  #define _EZPP_THROW_BAD_ALLOC                throw(std::bad_alloc)
+  #define _EZPP_NOEXCEPT                       throw()
+#endif
+
+#if defined(EZPP_ALLOC_HOOK_MALLOC) && defined(__GLIBC__)
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t n, size_t size);
+  void* __libc_realloc(void* p, size_t size);
+  void  __libc_free(void* p);
+  void* __libc_memalign(size_t align, size_t size);
+  void* __libc_valloc(size_t size);
+  void* __libc_pvalloc(size_t size);
+
+  void* malloc(size_t size) __THROW {
+    ::ezpp::detail::on_alloc(size);
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t n, size_t size) __THROW {
+    ::ezpp::detail::on_alloc(n * size);
+    return __libc_calloc(n, size);
+  }
+
+  // the aligned ones end in the free() below as well, so they are counted as allocations too
+  void* memalign(size_t align, size_t size) __THROW {
+    ::ezpp::detail::on_alloc(size);
+    return __libc_memalign(align, size);
+  }
+
+  void* aligned_alloc(size_t align, size_t size) __THROW {
+    ::ezpp::detail::on_alloc(size);
+    return __libc_memalign(align, size);
+  }
+
+  int posix_memalign(void** p, size_t align, size_t size) __THROW {
+    // glibc has no __libc_ one, its checks are done here
+    if (!align || align % sizeof(void*) || (align & (align - 1))) {
+      return EINVAL;
+    }
+    ::ezpp::detail::on_alloc(size);
+    void* mem = __libc_memalign(align, size);
+    if (!mem && size) {
+      return ENOMEM;
+    }
+    *p = mem;
+    return 0;
+  }
+
+  void* valloc(size_t size) __THROW {
+    ::ezpp::detail::on_alloc(size);
+    return __libc_valloc(size);
+  }
+
+  void* pvalloc(size_t size) __THROW {
+    ::ezpp::detail::on_alloc(size);
+    return __libc_pvalloc(size);
+  }
+
+  void* realloc(void* p, size_t size) __THROW {
+    if (p) {
+      ::ezpp::detail::on_free();
+    }
+    if (size) {
+      ::ezpp::detail::on_alloc(size);
+    }
+    return __libc_realloc(p, size);
+  }
+
+  void free(void* p) __THROW {
+    if (p) {
+      ::ezpp::detail::on_free();
+    }
+    __libc_free(p);
+  }
+}
+#elif defined(EZPP_ALLOC_HOOK)
+namespace ezpp {
+  namespace detail {
+    // as the standard operator new, the new handler gets to free memory until there is some
+    static void* hook_alloc(size_t size, size_t align) {
+      ::ezpp::detail::on_alloc(size);
+      if (!size) {
+        size = 1;
+      }
+      for (;;) {
+        void* p = 0;
+      #ifdef _WIN32
+        p = align ? _aligned_malloc(size, align) : malloc(size);
+      #else
+        if (!align) {
+          p = malloc(size);
+        }
+        else if (posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align, size)) {
+          p = 0;
+        }
+      #endif
+        if (p) {
+          return p;
+        }
+      #if __cplusplus >= 201103L
+        std::new_handler handler = std::get_new_handler();
+      #else
+        std::new_handler handler = std::set_new_handler(0);
+        std::set_new_handler(handler);
+      #endif
+        if (!handler) {
+          throw std::bad_alloc();
+        }
+        handler();
+      }
+    }
+
+    static void* hook_alloc_nothrow(size_t size, size_t align) _EZPP_NOEXCEPT {
+      try {
+        return hook_alloc(size, align);
+      }
+      catch (...) {
+        return 0;
+      }
+    }
+
+    static void hook_free(void* p, bool aligned) _EZPP_NOEXCEPT {
+      if (!p) {
+        return;
+      }
+      ::ezpp::detail::on_free();
+    #ifdef _WIN32
+      if (aligned) {
+        _aligned_free(p);
+        return;
+      }
+    #endif
+      (void)aligned;
+      free(p);
+    }
+  }
+}
+
+void* operator new(size_t size) _EZPP_THROW_BAD_ALLOC {
+  return ::ezpp::detail::hook_alloc(size, 0);
+}
+
+void* operator new[](size_t size) _EZPP_THROW_BAD_ALLOC {
+  return ::ezpp::detail::hook_alloc(size, 0);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) _EZPP_NOEXCEPT {
+  return ::ezpp::detail::hook_alloc_nothrow(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) _EZPP_NOEXCEPT {
+  return ::ezpp::detail::hook_alloc_nothrow(size, 0);
+}
+
+void operator delete(void* p) _EZPP_NOEXCEPT {
+  ::ezpp::detail::hook_free(p, false);
+}
+
+void operator delete[](void* p) _EZPP_NOEXCEPT {
+  ::ezpp::detail::hook_free(p, false);
+}
+
+void operator delete(void* p, const std::nothrow_t&) _EZPP_NOEXCEPT {
+  ::ezpp::detail::hook_free(p, false);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) _EZPP_NOEXCEPT {
+  ::ezpp::detail::hook_free(p, false);
+}
+
+#if __cpp_sized_deallocation >= 201309L || __cplusplus >= 201402L
+void operator delete(void* p, size_t) _EZPP_NOEXCEPT {
+  ::ezpp::detail::hook_free(p, false);
+}
+
+void operator delete[](void* p, size_t) _EZPP_NOEXCEPT {
+  ::ezpp::detail::hook_free(p, false);
+}
+#endif
+
+#if __cpp_aligned_new >= 201606L
+void* operator new(size_t size, std::align_val_t align) {
+  return ::ezpp::detail::hook_alloc(size, (size_t)align);
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+  return ::ezpp::detail::hook_alloc(size, (size_t)align);
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return ::ezpp::detail::hook_alloc_nothrow(size, (size_t)align);
+}
+
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return ::ezpp::detail::hook_alloc_nothrow(size, (size_t)align);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  ::ezpp::detail::hook_free(p, true);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  ::ezpp::detail::hook_free(p, true);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  ::ezpp::detail::hook_free(p, true);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  ::ezpp::detail::hook_free(p, true);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+  ::ezpp::detail::hook_free(p, true);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+  ::ezpp::detail::hook_free(p, true);
+}
+#endif
+#endif
+
+#ifdef EZPP_INSTRUMENT
+// the hooks of -finstrument-functions, anything ezpp calls from them or under its locks is not
+// recorded, so ezpp.hpp may be instrumented as well, but its functions called from the program
+// show up, -finstrument-functions-exclude-file-list=ezpp.hpp leaves them out. a longjmp over
+// instrumented calls leaves them open. calls are kept per execution context like scopes, so a
+// fiber switched out in a call ends it when it is switched in again
+static EZPP_TLS ::ezpp::detail::instr_ctx _ezpp_instr;
+
+extern "C" {
+  EZPP_NO_INSTRUMENT void __cyg_profile_func_enter(void* fn, void* /* call_site */) {
+    ::ezpp::detail::instr_ctx& c = _ezpp_instr;
+    if (c.busy) {
+      return;
+    }
+    ::ezpp::detail::exec_ctx& ctx = ::ezpp::detail::exec(::ezpp::detail::tls());
+    if (ctx.instrDepth == EZPP_INSTR_DEPTH) {
+      ++ctx.instrOverflow;
+      return;
+    }
+    c.busy = 1;
+    uint32_t x = c.seed ? c.seed : 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c.seed = x;
+    ::ezpp::node* n = ::ezpp::detail::instr_off() ? 0 : ::ezpp::inst().instrEnter(fn, x);
+    ctx.instrStack[ctx.instrDepth++] = n;
+    c.busy = 0;
+  }
+
+  EZPP_NO_INSTRUMENT void __cyg_profile_func_exit(void* /* fn */, void* /* call_site */) {
+    ::ezpp::detail::instr_ctx& c = _ezpp_instr;
+    if (c.busy) {
+      return;
+    }
+    ::ezpp::detail::exec_ctx& ctx = ::ezpp::detail::exec(::ezpp::detail::tls());
+    if (ctx.instrOverflow) {
+      --ctx.instrOverflow;
+      return;
+    }
+    if (!ctx.instrDepth) {
+      return;
+    }
+    ::ezpp::node* n = ctx.instrStack[--ctx.instrDepth];
+    if (n) {
+      c.busy = 1;
+      n->end(EZPP_THREAD_ID);
+      c.busy = 0;
+    }
+  }
+}
+#endif
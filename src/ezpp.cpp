@@ -0,0 +1,12 @@
+/*
+  ezpp -- Easy performance profiler for C++.
+
+  Copyright (c) 2010-2017 <http://ez8.co> <orca.zhang@yahoo.com>
+
+  This library is released under the MIT License.
+  Please see LICENSE file or visit https://github.com/ez8-co/ezpp for details.
+ */
+
+// the one translation unit of the ezpp library, users build with EZPP_LIBRARY
+#define EZPP_IMPLEMENTATION
+#include "ezpp.hpp"
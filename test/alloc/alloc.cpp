@@ -0,0 +1,85 @@
+#define EZPP_ALLOC_HOOK
+#include "../../ezpp.hpp"
+
+#include <iostream>
+
+#ifdef _MSC_VER
+	#include <windows.h>
+#else
+	#define Sleep(ms) usleep(ms * 1000)
+#endif
+
+using namespace std;
+
+void test_inner(void)
+{
+	EZPP();
+	std::vector<int> v;
+	for(int i = 0; i < 1000; i++) {
+		v.push_back(i);
+	}
+}
+
+void test(void)
+{
+	EZPP();
+	for(int i = 0; i < 10; i++) {
+		std::string* s = new std::string(256, 'x');
+		test_inner();
+		delete s;
+	}
+}
+
+void test_ex(void)
+{
+	EZPP_EX("EZPP_EX");
+	char* buf = new char[1024 * 1024];
+	Sleep(200);
+	delete[] buf;
+}
+
+void test_codeclip(void)
+{
+	EZPP_BEGIN(x);
+	int* p = new int[16];
+	EZPP_BEGIN(y);
+	int* q = new int[32];
+	EZPP_END(x);
+	delete[] p;
+	EZPP_END(y);
+	delete[] q;
+}
+
+#if __cpp_aligned_new >= 201606L
+// goes through the std::align_val_t overloads
+struct alignas(64) cache_line {
+	char data[64];
+};
+
+void test_aligned(void)
+{
+	EZPP();
+	cache_line* lines = new cache_line[8];
+	delete[] lines;
+	delete new cache_line;
+}
+#endif
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		test();
+		test_ex();
+		test_codeclip();
+#if __cpp_aligned_new >= 201606L
+		test_aligned();
+#endif
+		std::vector<char> outside(4096);
+	}
+	catch(std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+#define EZPP_ALLOC_HOOK_MALLOC
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#ifdef __GLIBC__
+	#include <malloc.h>
+#endif
+
+using namespace std;
+
+void test_malloc(void)
+{
+	EZPP();
+	for(int i = 0; i < 10; i++) {
+		char* p = (char*)malloc(256);
+		p = (char*)realloc(p, 512);
+		free(p);
+		free(calloc(16, 16));
+	}
+}
+
+#ifdef __GLIBC__
+// the aligned ones end in free() too, so their allocs match their frees
+void test_aligned(void)
+{
+	EZPP();
+	void* p = 0;
+	if (!posix_memalign(&p, 64, 1024)) {
+		free(p);
+	}
+	free(memalign(64, 1024));
+	free(aligned_alloc(64, 1024));
+	free(valloc(1024));
+}
+#endif
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		test_malloc();
+#ifdef __GLIBC__
+		test_aligned();
+#endif
+	}
+	catch(std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
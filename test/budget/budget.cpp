@@ -0,0 +1,66 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace std;
+
+void query(int id)
+{
+	EZPP();
+	// every 20th request hits a slow path
+	usleep(id % 20 ? 500 : 3000 + id * 10);
+}
+
+void handle(int id)
+{
+	EZPP();
+	EZPP_BUDGET(2);
+	query(id);
+}
+
+// filtered out below, its budget mustn't land on the caller
+void cache_lookup(void)
+{
+	EZPP_EX("cache");
+	EZPP_BUDGET(0.1);
+	usleep(300);
+}
+
+void batch(void)
+{
+	EZPP();
+	cache_lookup();
+	usleep(200);
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		// scopes without a budget of their own
+		EZPP_SET_BUDGET(3);
+
+		for(int i = 0; i < 200; i++) {
+			char tag[32];
+			sprintf(tag, "request %d", i);
+			EZPP_SET_TAG(tag);
+			handle(i);
+		}
+		EZPP_SET_TAG("");
+
+		// batch keeps the default budget of 3 ms, nothing of it is over
+		EZPP_SET_FILTER("-ext:cache");
+		for(int i = 0; i < 10; i++) {
+			batch();
+		}
+		EZPP_CLEAR_FILTER();
+		cout << "slowest: " << ezpp::inst().slowest().size() << endl;
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -82,10 +82,30 @@ void test_ex_do_(void)
 	test_ex_do ex_do3;
 }
 
+void test_many_(void)
+{
+	for(int i = 0; i < 100000; i++) {
+		test obj;
+	}
+	test* objs[16];
+	for(int i = 0; i < 16; i++) {
+		objs[i] = new test;
+		Sleep(i * 10);
+	}
+	for(int i = 0; i < 16; i++) {
+		delete objs[i];
+	}
+}
+
 int main(int argc,  char** argv)
 {
 	try {
 		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		test_many_();
+		EZPP_PRINT();
+		EZPP_CLEAR();
+
+		EZPP_ADD_OPTION(EZPP_OPT_CLS_DETAIL);
 		test_();
  		test_do_();
  		test_ex_();
@@ -0,0 +1,60 @@
+#include "../../ezpp.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+std::atomic<bool> run(true);
+std::atomic<long> opened(0);
+
+void leaf(void)
+{
+	EZPP();
+}
+
+// scopes open back to back, so a clear() hits sites right between their lookup and their call
+void worker(void)
+{
+	while(run) {
+		EZPP();
+		for(int i = 0; i < 100; i++) {
+			leaf();
+		}
+		opened += 101;
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		std::vector<std::thread> threads;
+		for(int i = 0; i < 8; i++) {
+			threads.push_back(std::thread(worker));
+		}
+
+		for(int i = 0; i < 200; i++) {
+			if(i % 2) {
+				EZPP_CLEAR();
+			}
+			else {
+				EZPP_RESET();
+			}
+		}
+
+		run = false;
+		for(size_t i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+		std::cout << "scopes opened: " << opened << std::endl;
+		EZPP_CLEAR();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
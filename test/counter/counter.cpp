@@ -0,0 +1,46 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// bytes per call and throughput next to the time per call
+size_t compress(const vector<char>& in)
+{
+	EZPP_CPU();
+	size_t out = 0;
+	for (size_t i = 0; i < in.size(); i++) {
+		out += (in[i] != (i ? in[i - 1] : 0));
+	}
+	EZPP_ADD("bytes", in.size());
+	EZPP_ADD("chunks", 1);
+	return out;
+}
+
+void handle(size_t size)
+{
+	EZPP();
+	vector<char> data(size, 'a');
+	compress(data);
+	EZPP_COUNT("requests", 1);
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		for(int i = 0; i < 100; i++) {
+			handle(64 * 1024 * (i % 4 + 1));
+		}
+		// outside of any scope, counted process wide only
+		EZPP_ADD("bytes", 1);
+		cout << "requests: " << ezpp::inst().counter("requests") << endl;
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+
+#ifdef _MSC_VER
+	#include <windows.h>
+#else
+	#define Sleep(ms) usleep(ms * 1000)
+#endif
+
+using namespace std;
+
+volatile size_t sink = 0;
+
+void busy(void)
+{
+	size_t x = 1;
+	for(size_t i = 0; i < 50000000; i++) {
+		x = x * 31 + i;
+	}
+	sink = x;
+}
+
+void test(void)
+{
+	EZPP_CPU();
+	busy();
+	Sleep(100);
+}
+
+void test_ex(void)
+{
+	EZPP_EX_CPU("EZPP_EX_CPU");
+	Sleep(200);
+}
+
+void test_codeclip(void)
+{
+	EZPP_BEGIN_CPU(x);
+	busy();
+	EZPP_END_CPU(x);
+
+	EZPP_BEGIN_EX_CPU(x, "EZPP_BEGIN_EX_CPU");
+	busy();
+	Sleep(50);
+	EZPP_END_EX_CPU(x);
+}
+
+void test_wall_only(void)
+{
+	EZPP();
+	busy();
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		test();
+		test_ex();
+		test_codeclip();
+		test_wall_only();
+		EZPP_PRINT();
+
+		printf("\nall sites\n");
+		EZPP_CLEAR();
+		EZPP_ADD_OPTION(EZPP_OPT_CPU_TIME);
+		test_wall_only();
+	}
+	catch(std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+
+using namespace std;
+
+void query(int ms)
+{
+	EZPP();
+	usleep(ms * 1000);
+}
+
+void handle(int i)
+{
+	EZPP_EX("request");
+	query(1 + i % 3);
+}
+
+void show(int seq)
+{
+	char file[64];
+	sprintf(file, "ezpp.log.%d.%d", (int)getpid(), seq);
+	FILE* fp = fopen(file, "rb");
+	if (!fp) {
+		printf("%s: missing\r\n", file);
+		return;
+	}
+	printf("---------- %s ----------\r\n", file);
+	char line[512];
+	while (fgets(line, sizeof(line), fp)) {
+		fputs(line, stdout);
+	}
+	fclose(fp);
+	remove(file);
+}
+
+// what `kill -USR1 <pid>` gets out of a running process
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		// a report, and a report starting the figures over
+		EZPP_DUMP_ON_SIGNAL(SIGUSR1, false);
+		EZPP_DUMP_ON_SIGNAL(SIGUSR2, true);
+
+		for(int i = 0; i < 30; i++) {
+			handle(i);
+		}
+		kill(getpid(), SIGUSR1);
+		usleep(100 * 1000);
+
+		kill(getpid(), SIGUSR2);
+		usleep(100 * 1000);
+
+		for(int i = 0; i < 10; i++) {
+			handle(i);
+		}
+		kill(getpid(), SIGUSR1);
+		usleep(100 * 1000);
+
+		// 30 calls, 30 calls, then the 10 after the reset
+		show(1);
+		show(2);
+		show(3);
+		EZPP_CLEAR();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <ucontext.h>
+
+#define FIBERS 3
+#define STACK_SIZE (256 * 1024)
+
+using namespace std;
+
+struct fiber {
+	ucontext_t uc;
+	ezpp::context ctx;
+	bool done;
+	char stack[STACK_SIZE];
+};
+
+ucontext_t sched;
+fiber* current = 0;
+fiber fibers[FIBERS];
+
+void yield(void)
+{
+	swapcontext(&current->uc, &sched);
+}
+
+void step(void)
+{
+	EZPP();
+	usleep(1000);
+}
+
+// begins on one thread and ends on another one, suspended in between
+void task(void)
+{
+	{
+		EZPP_EX("task");
+		for(int i = 0; i < 4; i++) {
+			step();
+			yield();
+		}
+	}
+	// back to the scheduler through uc_link
+	current->done = true;
+}
+
+// round robin, the context of a fiber is switched in while it runs
+void* run(void* rounds)
+{
+	for(long r = 0; r < (long)rounds; r++) {
+		for(int i = 0; i < FIBERS; i++) {
+			if (fibers[i].done)
+				continue;
+			current = &fibers[i];
+			ezpp::context_guard guard(current->ctx);
+			swapcontext(&sched, &current->uc);
+		}
+	}
+	return 0;
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		for(int i = 0; i < FIBERS; i++) {
+			getcontext(&fibers[i].uc);
+			fibers[i].uc.uc_stack.ss_sp = fibers[i].stack;
+			fibers[i].uc.uc_stack.ss_size = STACK_SIZE;
+			fibers[i].uc.uc_link = &sched;
+			fibers[i].done = false;
+			makecontext(&fibers[i].uc, task, 0);
+		}
+
+		// half of the rounds here, the rest on another thread
+		run((void*)2);
+		pthread_t t;
+		pthread_create(&t, 0, run, (void*)5);
+		pthread_join(t, 0);
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+
+#ifdef _MSC_VER
+	#include <windows.h>
+#else
+	#define Sleep(ms) usleep(ms * 1000)
+#endif
+
+using namespace std;
+
+void net_read(void)
+{
+	EZPP_EX("net");
+	Sleep(10);
+}
+
+void net_write(void)
+{
+	EZPP_EX("net");
+	Sleep(10);
+}
+
+void disk_read(void)
+{
+	EZPP_EX("disk");
+	Sleep(10);
+}
+
+void run(void)
+{
+	net_read();
+	net_write();
+	disk_read();
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		printf("exclude net\n");
+		EZPP_SET_FILTER("-ext:net");
+		run();
+		EZPP_PRINT();
+		EZPP_CLEAR();
+
+		printf("\nonly *_read, without clear or restart\n");
+		EZPP_SET_FILTER("+name:*_read");
+		run();
+		EZPP_PRINT();
+		EZPP_CLEAR();
+
+		printf("\nfirst match wins\n");
+		EZPP_SET_FILTER("-name:disk_*;+file:*filter.cpp");
+		run();
+		EZPP_PRINT();
+		EZPP_CLEAR();
+
+		printf("\nall\n");
+		EZPP_CLEAR_FILTER();
+		run();
+	}
+	catch(std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
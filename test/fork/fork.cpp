@@ -0,0 +1,84 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <sys/wait.h>
+
+#define WORKERS 3
+
+using namespace std;
+
+void parse(int ms)
+{
+	EZPP();
+	usleep(ms * 1000);
+}
+
+void handle(int id)
+{
+	EZPP_EX("request");
+	parse(1 + id);
+}
+
+// a preforking server, each worker saves its own profile through the pid template
+void worker(int id)
+{
+	for(int i = 0; i < 10 * (id + 1); i++) {
+		handle(id);
+	}
+	EZPP_SAVE_PROFILE("fork.%p.prof");
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		// measured by the parent only, workers start over
+		handle(0);
+
+		pid_t pids[WORKERS];
+		for(int i = 0; i < WORKERS; i++) {
+			pids[i] = fork();
+			if (!pids[i]) {
+				worker(i);
+				EZPP_CLEAR();
+				_exit(0);
+			}
+		}
+
+		ezpp::profile merged;
+		merged.processCnt = 0;
+		for(int i = 0; i < WORKERS; i++) {
+			waitpid(pids[i], 0, 0);
+			char file[64];
+			sprintf(file, "fork.%d.prof", (int)pids[i]);
+			ezpp::profile p;
+			if (p.load(file)) {
+				merged.merge(p);
+			}
+			remove(file);
+		}
+
+		printf("%" PRId64 " workers\r\n", merged.processCnt);
+		size_t threads = 0;
+		for(size_t i = 0; i < merged.entries.size(); i++) {
+			const ezpp::profile::entry& e = merged.entries[i];
+			printf("%s \"%s\": %" PRId64 " calls, mean %" PRId64 " us, p99 <= %" PRId64 " us\r\n",
+				e.name.c_str(), e.ext.c_str(), e.callCnt, e.mean(), e.p99());
+			threads += e.threadCost.size();
+		}
+		// thread ids of different workers aren't the same threads, the merge drops them
+		printf("thread figures: %u\r\n", (unsigned)threads);
+		for(size_t i = 0; i < merged.edges.size(); i++) {
+			const ezpp::profile::edge& ed = merged.edges[i];
+			printf("%llx -> %llx: %" PRId64 " calls\r\n",
+				(unsigned long long)ed.parent, (unsigned long long)ed.child, ed.callCnt);
+		}
+		EZPP_CLEAR();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,71 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+using namespace std;
+
+// workloads for ezpp-gate, deterministic and cpu bound so that runs compare
+
+#define OVERHEAD_SCOPES 10000
+
+unsigned int seed = 1;
+
+unsigned int next_rand(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+void test_sort(void)
+{
+	for(int i = 0; i < 50; i++) {
+		EZPP();
+		vector<unsigned int> v(20000);
+		for(size_t j = 0; j < v.size(); j++) {
+			v[j] = next_rand();
+		}
+		sort(v.begin(), v.end());
+	}
+}
+
+void test_map(void)
+{
+	for(int i = 0; i < 50; i++) {
+		EZPP();
+		map<string, int> m;
+		char key[16];
+		for(int j = 0; j < 5000; j++) {
+			sprintf(key, "%u", next_rand());
+			m[key] = j;
+		}
+	}
+}
+
+// ezpp's own cost: the outer scope divided by OVERHEAD_SCOPES is what one empty scope costs
+void test_overhead(void)
+{
+	for(int i = 0; i < 50; i++) {
+		EZPP_EX("overhead x10000");
+		for(int j = 0; j < OVERHEAD_SCOPES; j++) {
+			EZPP_EX("empty");
+		}
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		test_sort();
+		test_map();
+		test_overhead();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
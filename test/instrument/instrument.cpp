@@ -0,0 +1,58 @@
+#define EZPP_INSTRUMENT
+#include "../../ezpp.hpp"
+
+#include <iostream>
+
+using namespace std;
+
+// no EZPP macros below but the one in handle, the rest comes from -finstrument-functions
+
+__attribute__((noinline)) void parse(int ms)
+{
+	usleep(ms * 1000);
+}
+
+__attribute__((noinline)) void validate(void)
+{
+	usleep(500);
+}
+
+// left out by the filter in main
+__attribute__((noinline)) void noise(void)
+{
+	usleep(100);
+}
+
+void handle(int i)
+{
+	EZPP_EX("request");
+	parse(1 + i % 2);
+	validate();
+	noise();
+}
+
+__attribute__((noinline)) void serve(int n)
+{
+	for(int i = 0; i < n; i++) {
+		handle(i);
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		EZPP_ADD_FILTER("-name:noise*");
+
+		serve(20);
+
+		// 1 of every 4 calls from here on
+		EZPP_INSTRUMENT_SAMPLE(4);
+		serve(20);
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
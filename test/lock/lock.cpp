@@ -0,0 +1,70 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+std::mutex hot;
+std::mutex cold;
+ezpp::mutex wrapped("wrapped queue");
+
+int counter = 0;
+
+void test_hot(void)
+{
+	for(int i = 0; i < 200; i++) {
+		EZPP_LOCK(hot);
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+		counter++;
+	}
+}
+
+void test_cold(void)
+{
+	for(int i = 0; i < 10000; i++) {
+		EZPP_LOCK_EX(cold, "EZPP_LOCK_EX");
+		counter++;
+	}
+}
+
+// two locks held in one scope, always in the same order
+void test_both(void)
+{
+	for(int i = 0; i < 100; i++) {
+		EZPP_LOCK(hot);
+		EZPP_LOCK_EX(cold, "EZPP_LOCK_EX nested");
+		counter++;
+	}
+}
+
+void test_wrapped(void)
+{
+	for(int i = 0; i < 200; i++) {
+		std::lock_guard<ezpp::mutex> guard(wrapped);
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		std::vector<std::thread> threads;
+		for(int i = 0; i < 4; i++) {
+			threads.push_back(std::thread(test_hot));
+			threads.push_back(std::thread(test_cold));
+			threads.push_back(std::thread(test_wrapped));
+			threads.push_back(std::thread(test_both));
+		}
+		for(size_t i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
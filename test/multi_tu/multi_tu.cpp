@@ -0,0 +1,21 @@
+#include "../../ezpp.hpp"
+
+#include <cstdio>
+
+// defined in worker.cpp, which includes ezpp.hpp as well
+int fib(int n);
+int sum(int n);
+
+int main(void)
+{
+	EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+	int r = 0;
+	for (int i = 0; i < 1000; ++i) {
+		EZPP_EX("main loop");
+		r += fib(i % 40) + sum(i);
+	}
+	// both translation units report into the one registry, printed at exit
+	printf("result %d\n", r);
+	return 0;
+}
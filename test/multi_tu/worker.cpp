@@ -0,0 +1,23 @@
+#include "../../ezpp.hpp"
+
+int fib(int n)
+{
+	EZPP();
+	int a = 0, b = 1;
+	for (int i = 0; i < n; ++i) {
+		int t = a + b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+int sum(int n)
+{
+	EZPP_EX("sum");
+	int s = 0;
+	for (int i = 0; i < n; ++i) {
+		s += i;
+	}
+	return s;
+}
@@ -0,0 +1,80 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <cstdlib>
+
+#ifdef _MSC_VER
+	#include <windows.h>
+#else
+	#define Sleep(ms) usleep(ms * 1000)
+#endif
+
+using namespace std;
+
+#define TEST_SIZE (8 * 1024 * 1024)
+
+volatile size_t sink = 0;
+
+void test_compute(void)
+{
+	EZPP_EX("compute bound");
+	size_t x = 1;
+	for(size_t i = 0; i < 100000000; i++) {
+		x = x * 31 + i;
+	}
+	sink = x;
+}
+
+void test_memory(const std::vector<size_t>& v)
+{
+	EZPP_EX("memory bound");
+	size_t idx = 0;
+	for(size_t i = 0; i < TEST_SIZE; i++) {
+		idx = v[idx];
+	}
+	sink = idx;
+}
+
+void test_branch(const std::vector<size_t>& v)
+{
+	EZPP_EX("branch bound");
+	size_t cnt = 0;
+	for(size_t i = 0; i < TEST_SIZE; i++) {
+		if(v[i] & 1) {
+			cnt++;
+		}
+	}
+	sink = cnt;
+}
+
+void test_sleep(void)
+{
+	EZPP_EX("sleep");
+	for(int i = 0; i < 10; i++) {
+		Sleep(10);
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE | EZPP_OPT_PERF_COUNTER);
+
+		std::vector<size_t> v(TEST_SIZE);
+		for(size_t i = 0; i < TEST_SIZE; i++) {
+			v[i] = (size_t)rand() % TEST_SIZE;
+		}
+
+		for(int i = 0; i < 3; i++) {
+			test_compute();
+			test_memory(v);
+			test_branch(v);
+			test_sleep();
+		}
+	}
+	catch(std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+
+#ifdef _MSC_VER
+	#include <windows.h>
+#else
+	#define Sleep(ms) usleep(ms * 1000)
+#endif
+
+using namespace std;
+
+void parse(int ms)
+{
+	EZPP();
+	Sleep(ms);
+}
+
+void old_path(void)
+{
+	EZPP();
+	Sleep(2);
+}
+
+void new_path(void)
+{
+	EZPP();
+	Sleep(1);
+}
+
+void run(bool release)
+{
+	for(int i = 0; i < 20; i++) {
+		EZPP_EX("request");
+		parse(release ? 3 : 1);
+		if (release) {
+			new_path();
+		}
+		else {
+			old_path();
+		}
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		run(false);
+		EZPP_SAVE_PROFILE("before.prof");
+		EZPP_CLEAR();
+
+		run(true);
+		ezpp::profile before, after = ezpp::inst().snapshot();
+		if (before.load("before.prof")) {
+			ezpp::profile::output(stdout, before, after, ezpp::profile::diff(before, after));
+		}
+		EZPP_CLEAR();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
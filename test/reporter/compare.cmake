@@ -0,0 +1,42 @@
+# the json of json_reporter and of ezpp-report -v json on the profile of the same run name
+# sites and threads alike, run by ctest as ezpp_json_ids
+EXECUTE_PROCESS(COMMAND ${REPORTER} ${WORK}/reporter.json ${WORK}/reporter.prof
+    OUTPUT_QUIET RESULT_VARIABLE result)
+IF(result)
+    MESSAGE(FATAL_ERROR "${REPORTER} failed: ${result}")
+ENDIF()
+EXECUTE_PROCESS(COMMAND ${REPORT} -v json ${WORK}/reporter.prof
+    OUTPUT_VARIABLE report RESULT_VARIABLE result)
+IF(result)
+    MESSAGE(FATAL_ERROR "${REPORT} failed: ${result}")
+ENDIF()
+FILE(READ ${WORK}/reporter.json reporter)
+
+FUNCTION(COLLECT out text pattern)
+    STRING(REGEX MATCHALL "${pattern}" matches "${text}")
+    SET(values)
+    FOREACH(m ${matches})
+        STRING(REGEX REPLACE "${pattern}" "\\1" v "${m}")
+        LIST(APPEND values ${v})
+    ENDFOREACH()
+    IF(values)
+        LIST(REMOVE_DUPLICATES values)
+        LIST(SORT values)
+    ENDIF()
+    SET(${out} "${values}" PARENT_SCOPE)
+ENDFUNCTION()
+
+COLLECT(reporter_ids "${reporter}" "\"id\":\"([0-9a-f]+)\"")
+COLLECT(report_ids "${report}" "\"id\":\"([0-9a-f]+)\"")
+COLLECT(reporter_threads "${reporter}" "\"key\":\"([0-9a-f]+)\"")
+COLLECT(report_threads "${report}" "\"threads\":{\"([0-9a-f]+)\":")
+
+IF(NOT reporter_ids OR NOT reporter_threads)
+    MESSAGE(FATAL_ERROR "no sites or threads in ${WORK}/reporter.json")
+ENDIF()
+IF(NOT "${reporter_ids}" STREQUAL "${report_ids}")
+    MESSAGE(FATAL_ERROR "site ids differ: ${reporter_ids} vs ${report_ids}")
+ENDIF()
+IF(NOT "${reporter_threads}" STREQUAL "${report_threads}")
+    MESSAGE(FATAL_ERROR "thread keys differ: ${reporter_threads} vs ${report_threads}")
+ENDIF()
@@ -0,0 +1,70 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+// pushes numbers into a metrics library, here one line per gauge
+class metrics_reporter : public ezpp::reporter {
+public:
+	virtual void report(const ezpp::view& v) {
+		ezpp::view::site_range sites = v.sites();
+		for (ezpp::view::site_range::iterator it = sites.begin(); it != sites.end(); ++it) {
+			ezpp::site_view s = *it;
+			cout << "ezpp.calls{site=\"" << s.name() << "\"} " << s.callCnt() << endl;
+			cout << "ezpp.p99_us{site=\"" << s.name() << "\"} " << s.duration().percentile(0.99) << endl;
+			ezpp::site_view::caller_range callers = s.callers();
+			for (ezpp::site_view::caller_range::iterator cit = callers.begin(); cit != callers.end(); ++cit) {
+				ezpp::caller_cost c = *cit;
+				const ezpp::site* parent = v.findSite(c.parent);
+				cout << "ezpp.calls{site=\"" << s.name() << "\",caller=\"" << (parent ? parent->name() : "?")
+					<< "\"} " << c.callCnt << endl;
+			}
+		}
+	}
+};
+
+void query()
+{
+	EZPP();
+	usleep(100);
+}
+
+void handle()
+{
+	EZPP();
+	query();
+	query();
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		for(int i = 0; i < 50; i++) {
+			handle();
+		}
+		metrics_reporter m;
+		EZPP_REPORT(m);
+		ezpp::json_reporter json(stdout);
+		EZPP_REPORT(json);
+
+		// for compare.cmake, the json of the reporter and a profile for ezpp-report -v json
+		if (argc > 2) {
+			FILE* fp = fopen(argv[1], "w");
+			if (fp) {
+				ezpp::json_reporter file(fp);
+				EZPP_REPORT(file);
+				fclose(fp);
+			}
+			EZPP_SAVE_PROFILE(argv[2]);
+		}
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include "../../ezpp.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+std::atomic<bool> run(true);
+
+void leaf(void)
+{
+	EZPP();
+	std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+// scopes stay open across the resets and clears of the main thread
+void worker(void)
+{
+	while(run) {
+		EZPP();
+		for(int i = 0; i < 10; i++) {
+			leaf();
+		}
+		ezpp::span s;
+		EZPP_SPAN_START(s);
+		EZPP_SPAN_END(s);
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		std::vector<std::thread> threads;
+		for(int i = 0; i < 4; i++) {
+			threads.push_back(std::thread(worker));
+		}
+
+		for(int i = 0; i < 20; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			if(i % 5 == 4) {
+				EZPP_CLEAR();
+			}
+			else {
+				EZPP_RESET();
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		run = false;
+		for(size_t i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+		// only the last 100 ms
+		EZPP_PRINT();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,50 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <thread>
+#include <cstdlib>
+using namespace std;
+
+void test_block(void)
+{
+	EZPP_EX("block");
+	for(int i = 0; i < 20; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+}
+
+void test_fault(void)
+{
+	EZPP_EX("fault");
+	size_t size = 64 * 1024 * 1024;
+	char* p = (char*)malloc(size);
+	for(size_t i = 0; i < size; i += 4096) {
+		p[i] = 1;
+	}
+	free(p);
+}
+
+void test_mt(void)
+{
+	test_block();
+	test_fault();
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE | EZPP_OPT_RUSAGE);
+		test_block();
+		test_fault();
+
+		std::thread t1(test_mt);
+		std::thread t2(test_mt);
+		t1.join();
+		t2.join();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
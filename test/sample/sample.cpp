@@ -0,0 +1,73 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <signal.h>
+
+using namespace std;
+
+volatile int scale = 1000000;
+
+// uninstrumented, only the samples tell them apart inside handle
+__attribute__((noinline)) void parse(int n)
+{
+	volatile double sink = 0;
+	for(int i = 0; i < n; i++) {
+		sink = sink + i * 0.5;
+	}
+}
+
+__attribute__((noinline)) void checksum(int n)
+{
+	volatile double sink = 0;
+	for(int i = 0; i < n; i++) {
+		sink = sink * 0.999 + i;
+	}
+}
+
+void handle(void)
+{
+	EZPP();
+	parse(3 * scale);
+	checksum(scale);
+}
+
+// installed before ezpp samples, gets the SIGPROF that aren't ezpp's own
+volatile sig_atomic_t chained = 0;
+
+void other_profiler(int)
+{
+	chained = chained + 1;
+}
+
+void* worker(void*)
+{
+	for(int i = 0; i < 20; i++) {
+		handle();
+	}
+	return 0;
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		signal(SIGPROF, other_profiler);
+		EZPP_SET_SAMPLING(1000);
+
+		pthread_t threads[2];
+		for(int i = 0; i < 2; i++) {
+			pthread_create(&threads[i], 0, worker, 0);
+		}
+		worker(0);
+		for(int i = 0; i < 2; i++) {
+			pthread_join(threads[i], 0);
+		}
+		raise(SIGPROF);
+		cout << "chained SIGPROF: " << chained << endl;
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
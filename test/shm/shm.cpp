@@ -0,0 +1,79 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+using namespace std;
+
+std::atomic<bool> running(true);
+
+void test_fast(void)
+{
+	while (running) {
+		EZPP_EX("fast");
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+}
+
+void test_slow(void)
+{
+	while (running) {
+		EZPP_EX("slow");
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+}
+
+// open for the whole run, published from the steps ending inside
+void test_loop(void)
+{
+	EZPP_EX("loop");
+	while (running) {
+		EZPP_EX("step");
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+// what an external reader sees, here attached to our own pid
+void dump(const ezpp::shm::segment& seg)
+{
+	printf("segment %s, %u site(s)\n", ezpp::shm::segment::name((int)seg.hdr()->pid).c_str(), seg.count());
+	for (unsigned int i = 0; i < seg.count(); i++) {
+		const ezpp::shm::record& r = seg.at(i);
+		ezpp::shm::stat st;
+		if (ezpp::shm::read(r, st)) {
+			printf("  %s:%d %s \"%s\" calls %" PRId64 " time %" PRId64 " us\n",
+				r.file, r.line, r.name, r.ext, st.callCnt, st.totalCost);
+		}
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+		EZPP_ADD_OPTION(EZPP_OPT_SHM);
+
+		std::thread fast(test_fast);
+		std::thread slow(test_slow);
+		std::thread loop(test_loop);
+
+		ezpp::shm::segment seg;
+		if (!seg.open((int)getpid())) {
+			printf("no segment\n");
+		}
+		for (int i = 0; i < 3 && seg.valid(); i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			dump(seg);
+		}
+
+		running = false;
+		fast.join();
+		slow.join();
+		loop.join();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
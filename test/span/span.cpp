@@ -0,0 +1,75 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <utility>
+using namespace std;
+
+struct request {
+	int id;
+	ezpp::span span;
+};
+
+std::mutex m;
+std::condition_variable cv;
+std::deque<request> q;
+bool closed = false;
+
+// accepts requests, each one is timed from here to the worker finishing it, the span moves
+// along with its request
+void io_thread(int cnt)
+{
+	for (int i = 0; i < cnt; i++) {
+		request r;
+		r.id = i;
+		EZPP_SPAN_START_EX(r.span, "request");
+		{
+			std::lock_guard<std::mutex> lock(m);
+			q.push_back(std::move(r));
+		}
+		cv.notify_one();
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+	}
+	std::lock_guard<std::mutex> lock(m);
+	closed = true;
+	cv.notify_all();
+}
+
+void worker(void)
+{
+	for (;;) {
+		request r;
+		{
+			std::unique_lock<std::mutex> lock(m);
+			cv.wait(lock, [] { return closed || !q.empty(); });
+			if (q.empty())
+				return;
+			r = std::move(q.front());
+			q.pop_front();
+		}
+		EZPP_SPAN_MARK(r.span);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		EZPP_SPAN_END(r.span);
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		std::thread io(io_thread, 50);
+		std::thread w1(worker), w2(worker);
+		io.join();
+		w1.join();
+		w2.join();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
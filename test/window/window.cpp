@@ -0,0 +1,45 @@
+#include "../../ezpp.hpp"
+
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+void handle(int us)
+{
+	EZPP();
+	usleep(us);
+}
+
+// figures of the last second only, the totals since start average the slow phase away
+void recent()
+{
+	ezpp::profile p = ezpp::inst().recent(1);
+	for (size_t i = 0; i < p.entries.size(); i++) {
+		const ezpp::profile::entry& e = p.entries[i];
+		cout << e.name << ": " << e.callCnt * 1000000.0 / p.elapsed << " calls/s, mean " << e.mean()
+			<< " us, p99 <= " << e.p99() << " us" << endl;
+	}
+}
+
+int main(int argc,  char** argv)
+{
+	try {
+		EZPP_ADD_OPTION(EZPP_OPT_FORCE_ENABLE);
+
+		// fast for a few seconds, then a slow spike
+		for(int i = 0; i < 2000; i++) {
+			handle(1000);
+		}
+		recent();
+		for(int i = 0; i < 200; i++) {
+			handle(5000);
+		}
+		recent();
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
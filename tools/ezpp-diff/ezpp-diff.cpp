@@ -0,0 +1,82 @@
+/*
+  ezpp-diff -- compare two profiles saved by ezpp.
+
+  Copyright (c) 2010-2017 <http://ez8.co> <orca.zhang@yahoo.com>
+
+  This library is released under the MIT License.
+  Please see LICENSE file or visit https://github.com/ez8-co/ezpp for details.
+ */
+#include "ezpp.hpp"
+
+namespace {
+
+  double change(int64_t before, int64_t after) {
+    if (!before) {
+      return after ? 100 : 0;
+    }
+    double r = (double)(after - before) * 100 / before;
+    return r < 0 ? -r : r;
+  }
+
+  void usage() {
+    fprintf(stderr,
+      "usage: ezpp-diff [-t percent] [-n count] <before> <after>\r\n"
+      "  compares profiles saved with EZPP_SAVE_PROFILE(file) or EZPP_PROFILE=<file>\r\n"
+      "  -t  hide sites whose total and mean time changed less than percent\r\n"
+      "  -n  show at most count changed sites\r\n");
+  }
+
+}
+
+int main(int argc, char** argv) {
+  double threshold = 0;
+  long top = -1;
+  const char* files[2] = { 0, 0 };
+  int fileCnt = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-t" && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    }
+    else if (arg == "-n" && i + 1 < argc) {
+      top = atol(argv[++i]);
+    }
+    else if (arg[0] != '-' && fileCnt < 2) {
+      files[fileCnt++] = argv[i];
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (fileCnt != 2) {
+    usage();
+    return 1;
+  }
+
+  ezpp::profile before, after;
+  for (int i = 0; i < 2; ++i) {
+    if (!(i ? after : before).load(files[i])) {
+      fprintf(stderr, "ezpp-diff: can't load profile %s\r\n", files[i]);
+      return 2;
+    }
+  }
+
+  std::vector<ezpp::profile::delta> all = ezpp::profile::diff(before, after), shown;
+  long changed = 0;
+  for (size_t i = 0; i < all.size(); ++i) {
+    const ezpp::profile::delta& d = all[i];
+    if (d.before && d.after) {
+      if (change(d.before->totalCost, d.after->totalCost) < threshold
+        && change(d.before->mean(), d.after->mean()) < threshold) {
+        continue;
+      }
+      if (top >= 0 && changed++ >= top) {
+        continue;
+      }
+    }
+    shown.push_back(d);
+  }
+  ezpp::profile::output(stdout, before, after, shown);
+  return 0;
+}
@@ -0,0 +1,339 @@
+/*
+  ezpp-gate -- fail a build when instrumented sites got slower than their baseline.
+
+  Copyright (c) 2010-2017 <http://ez8.co> <orca.zhang@yahoo.com>
+
+  This library is released under the MIT License.
+  Please see LICENSE file or visit https://github.com/ez8-co/ezpp for details.
+ */
+#include "ezpp.hpp"
+
+#include <cmath>
+#include <sys/wait.h>
+
+#define GATE_VERSION      1
+#define GATE_RUNS         5
+#define GATE_TOLERANCE    10.0  // percent
+#define GATE_SIGMA        3.0
+
+namespace {
+
+  // per call mean time of a site over several runs of the workload
+  struct sample {
+    std::string file;
+    std::string name;
+    std::string ext;
+    std::vector<double> values;
+    double mean;
+    double sd;
+
+    sample() : mean(0), sd(0) {}
+
+    void finish() {
+      mean = sd = 0;
+      if (values.empty()) {
+        return;
+      }
+      for (size_t i = 0; i < values.size(); ++i) {
+        mean += values[i];
+      }
+      mean /= values.size();
+      if (values.size() > 1) {
+        for (size_t i = 0; i < values.size(); ++i) {
+          sd += (values[i] - mean) * (values[i] - mean);
+        }
+        sd = sqrt(sd / (values.size() - 1));
+      }
+    }
+  };
+
+  typedef std::map<std::string, sample> sample_map;
+
+  struct tolerance {
+    std::string pattern;
+    double percent;
+  };
+
+  std::string key(const std::string& file, const std::string& name, const std::string& ext) {
+    return file + '\t' + name + '\t' + ext;
+  }
+
+  // runs argv with EZPP_PROFILE pointing at a scratch file and loads what it saved
+  bool run(char** argv, ezpp::profile& p) {
+    char file[] = "/tmp/ezpp-gate-XXXXXX";
+    int fd = mkstemp(file);
+    if (fd < 0) {
+      return false;
+    }
+    close(fd);
+    pid_t pid = fork();
+    if (!pid) {
+      setenv("EZPP_PROFILE", file, 1);
+      // the report printed at exit is not ours to show
+      int null = open("/dev/null", O_WRONLY);
+      if (null >= 0) {
+        dup2(null, 1);
+      }
+      execvp(argv[0], argv);
+      _exit(127);
+    }
+    int status = 0;
+    bool ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && !WEXITSTATUS(status)
+      && p.load(file);
+    unlink(file);
+    if (!ok) {
+      fprintf(stderr, "ezpp-gate: %s failed or saved no profile\r\n", argv[0]);
+    }
+    return ok;
+  }
+
+  bool collect(char** argv, int runs, sample_map& samples) {
+    for (int r = 0; r < runs; ++r) {
+      ezpp::profile p;
+      if (!run(argv, p)) {
+        return false;
+      }
+      for (size_t i = 0; i < p.entries.size(); ++i) {
+        const ezpp::profile::entry& e = p.entries[i];
+        if (!e.callCnt) {
+          continue;
+        }
+        size_t slash = e.file.find_last_of("/\\");
+        std::string file = slash == std::string::npos ? e.file : e.file.substr(slash + 1);
+        sample& s = samples[key(file, e.name, e.ext)];
+        s.file = file;
+        s.name = e.name;
+        s.ext = e.ext;
+        s.values.push_back((double)e.totalCost / e.callCnt);
+      }
+    }
+    for (sample_map::iterator it = samples.begin(); it != samples.end(); ++it) {
+      it->second.finish();
+    }
+    return true;
+  }
+
+  bool save(const std::string& file, int runs, const sample_map& samples) {
+    FILE* fp = fopen(file.c_str(), "wb+");
+    if (!fp) {
+      return false;
+    }
+    fprintf(fp, "ezpp-baseline\t%d\t%d\n", GATE_VERSION, runs);
+    for (sample_map::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+      const sample& s = it->second;
+      fprintf(fp, "%s\t%s\t%s\t%u\t%.3f\t%.3f\n", s.file.c_str(), s.name.c_str(), s.ext.c_str(),
+        (unsigned)s.values.size(), s.mean, s.sd);
+    }
+    return fclose(fp) == 0;
+  }
+
+  bool load(const std::string& file, sample_map& samples) {
+    FILE* fp = fopen(file.c_str(), "rb");
+    if (!fp) {
+      return false;
+    }
+    char line[1024];
+    bool ok = fgets(line, sizeof(line), fp) && !strncmp(line, "ezpp-baseline\t", 14) && atoi(line + 14) == GATE_VERSION;
+    while (ok && fgets(line, sizeof(line), fp)) {
+      char* fields[6];
+      int cnt = 0;
+      for (char* p = line; cnt < 6; ++cnt) {
+        fields[cnt] = p;
+        p = strpbrk(p, "\t\r\n");
+        if (!p) {
+          ++cnt;
+          break;
+        }
+        *p++ = '\0';
+      }
+      if (cnt < 6) {
+        continue;
+      }
+      sample& s = samples[key(fields[0], fields[1], fields[2])];
+      s.file = fields[0];
+      s.name = fields[1];
+      s.ext = fields[2];
+      s.values.assign((size_t)atoi(fields[3]), 0);
+      s.mean = atof(fields[4]);
+      s.sd = atof(fields[5]);
+    }
+    fclose(fp);
+    return ok;
+  }
+
+  // "<glob on name, or on name \"ext\"> <percent>" per line, '#' starts a comment
+  bool loadTolerances(const std::string& file, std::vector<tolerance>& tols) {
+    FILE* fp = fopen(file.c_str(), "rb");
+    if (!fp) {
+      return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+      std::string l(line);
+      size_t hash = l.find('#');
+      if (hash != std::string::npos) {
+        l.erase(hash);
+      }
+      size_t end = l.find_last_not_of(" \t\r\n");
+      if (end == std::string::npos) {
+        continue;
+      }
+      l.erase(end + 1);
+      size_t sep = l.find_last_of(" \t");
+      if (sep == std::string::npos) {
+        continue;
+      }
+      tolerance t;
+      t.pattern = l.substr(0, l.find_last_not_of(" \t", sep) + 1);
+      t.percent = atof(l.c_str() + sep + 1);
+      tols.push_back(t);
+    }
+    fclose(fp);
+    return true;
+  }
+
+  double toleranceOf(const sample& s, const std::vector<tolerance>& tols, double fallback) {
+    std::string full = s.ext.empty() ? s.name : s.name + " \"" + s.ext + "\"";
+    for (size_t i = 0; i < tols.size(); ++i) {
+      if (ezpp::site_filter::glob(tols[i].pattern.c_str(), s.name.c_str())
+        || ezpp::site_filter::glob(tols[i].pattern.c_str(), full.c_str())) {
+        return tols[i].percent;
+      }
+    }
+    return fallback;
+  }
+
+  void usage() {
+    fprintf(stderr,
+      "usage: ezpp-gate record -o <baseline> [-r runs] -- <workload> [args]\r\n"
+      "       ezpp-gate check -b <baseline> [-r runs] [-t percent] [-k sigmas] [-T file] [-s glob=percent] -- <workload> [args]\r\n"
+      "  the workload runs -r times (%d by default) and saves its profile through EZPP_PROFILE,\r\n"
+      "  a site regresses when its mean time per call grew by more than its tolerance (-t, %.0f%%\r\n"
+      "  by default, -s or a -T file per site) and by more than -k (%.0f) standard errors of the runs\r\n",
+      GATE_RUNS, GATE_TOLERANCE, GATE_SIGMA);
+  }
+
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+  std::string mode = argv[1];
+  std::string baseline;
+  int runs = GATE_RUNS;
+  double tol = GATE_TOLERANCE, sigma = GATE_SIGMA;
+  std::vector<tolerance> tols;
+  int i = 2;
+  for (; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--") {
+      ++i;
+      break;
+    }
+    if ((arg == "-o" || arg == "-b") && i + 1 < argc) {
+      baseline = argv[++i];
+    }
+    else if (arg == "-r" && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    }
+    else if (arg == "-t" && i + 1 < argc) {
+      tol = atof(argv[++i]);
+    }
+    else if (arg == "-k" && i + 1 < argc) {
+      sigma = atof(argv[++i]);
+    }
+    else if (arg == "-T" && i + 1 < argc) {
+      if (!loadTolerances(argv[++i], tols)) {
+        fprintf(stderr, "ezpp-gate: can't read tolerances %s\r\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (arg == "-s" && i + 1 < argc) {
+      std::string spec = argv[++i];
+      size_t eq = spec.rfind('=');
+      if (eq == std::string::npos) {
+        usage();
+        return 2;
+      }
+      tolerance t;
+      t.pattern = spec.substr(0, eq);
+      t.percent = atof(spec.c_str() + eq + 1);
+      // command line entries take precedence over the file
+      tols.insert(tols.begin(), t);
+    }
+    else {
+      usage();
+      return 2;
+    }
+  }
+  if (i >= argc || baseline.empty() || runs < 1 || (mode != "record" && mode != "check")) {
+    usage();
+    return 2;
+  }
+
+  sample_map current;
+  if (!collect(argv + i, runs, current)) {
+    return 2;
+  }
+
+  if (mode == "record") {
+    if (!save(baseline, runs, current)) {
+      fprintf(stderr, "ezpp-gate: can't write %s\r\n", baseline.c_str());
+      return 2;
+    }
+    printf("ezpp-gate: recorded %u site(s) over %d run(s) into %s\r\n", (unsigned)current.size(), runs, baseline.c_str());
+    return 0;
+  }
+
+  sample_map base;
+  if (!load(baseline, base)) {
+    fprintf(stderr, "ezpp-gate: can't read baseline %s\r\n", baseline.c_str());
+    return 2;
+  }
+
+  int regressed = 0;
+  printf("%-40s %20s %20s %9s %6s  %s\r\n", "SITE", "BASELINE (us)", "CURRENT (us)", "CHANGE", "TOL", "RESULT");
+  for (sample_map::const_iterator it = base.begin(); it != base.end(); ++it) {
+    const sample& b = it->second;
+    std::string site = b.ext.empty() ? b.name : b.name + " \"" + b.ext + "\"";
+    char bs[32], cs[32] = "-", change[16] = "-";
+    snprintf(bs, sizeof(bs), "%.2f +- %.2f", b.mean, b.sd);
+    sample_map::const_iterator cur = current.find(it->first);
+    if (cur == current.end()) {
+      printf("%-40s %20s %20s %9s %6s  %s\r\n", site.c_str(), bs, cs, change, "", "vanished");
+      continue;
+    }
+    const sample& c = cur->second;
+    double limit = toleranceOf(b, tols, tol);
+    double diff = c.mean - b.mean;
+    double pct = b.mean > 0 ? diff * 100 / b.mean : 0;
+    // standard error of the difference of the two means, the runs are the noise model
+    double se = sqrt(b.sd * b.sd / (b.values.empty() ? 1 : b.values.size()) + c.sd * c.sd / c.values.size());
+    const char* result = "ok";
+    if (pct > limit && diff > sigma * se) {
+      result = "REGRESSED";
+      ++regressed;
+    }
+    else if (pct < -limit && -diff > sigma * se) {
+      result = "improved";
+    }
+    snprintf(cs, sizeof(cs), "%.2f +- %.2f", c.mean, c.sd);
+    snprintf(change, sizeof(change), "%+.1f%%", pct);
+    char tl[16];
+    snprintf(tl, sizeof(tl), "%.0f%%", limit);
+    printf("%-40s %20s %20s %9s %6s  %s\r\n", site.c_str(), bs, cs, change, tl, result);
+  }
+  for (sample_map::const_iterator it = current.begin(); it != current.end(); ++it) {
+    if (base.find(it->first) == base.end()) {
+      const sample& c = it->second;
+      std::string site = c.ext.empty() ? c.name : c.name + " \"" + c.ext + "\"";
+      char cs[32];
+      snprintf(cs, sizeof(cs), "%.2f +- %.2f", c.mean, c.sd);
+      printf("%-40s %20s %20s %9s %6s  %s\r\n", site.c_str(), "-", cs, "-", "", "new");
+    }
+  }
+  printf("ezpp-gate: %d site(s) regressed\r\n", regressed);
+  return regressed ? 1 : 0;
+}
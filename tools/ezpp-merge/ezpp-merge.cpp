@@ -0,0 +1,65 @@
+/*
+  ezpp-merge -- sum up profiles saved by several processes of one program.
+
+  Copyright (c) 2010-2017 <http://ez8.co> <orca.zhang@yahoo.com>
+
+  This library is released under the MIT License.
+  Please see LICENSE file or visit https://github.com/ez8-co/ezpp for details.
+ */
+#include "ezpp.hpp"
+
+namespace {
+
+  void usage() {
+    fprintf(stderr,
+      "usage: ezpp-merge -o <output> <profile>...\r\n"
+      "  merges profiles of worker processes, e.g. saved with EZPP_PROFILE=app.%%p.prof, into one\r\n"
+      "  call counts, times, allocations, duration histograms and call edges are summed up,\r\n"
+      "  the elapsed time is the longest of them\r\n");
+  }
+
+}
+
+int main(int argc, char** argv) {
+  const char* output = 0;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      output = argv[++i];
+    }
+    else if (arg[0] != '-') {
+      files.push_back(argv[i]);
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (!output || files.empty()) {
+    usage();
+    return 1;
+  }
+
+  ezpp::profile merged;
+  for (size_t i = 0; i < files.size(); ++i) {
+    ezpp::profile p;
+    if (!p.load(files[i])) {
+      fprintf(stderr, "ezpp-merge: can't load profile %s\r\n", files[i]);
+      return 2;
+    }
+    if (i) {
+      merged.merge(p);
+    }
+    else {
+      merged = p;
+    }
+  }
+  if (!merged.save(output)) {
+    fprintf(stderr, "ezpp-merge: can't save profile %s\r\n", output);
+    return 2;
+  }
+  printf("%" PRId64 " processes, %u sites, %u edges -> %s\r\n",
+    merged.processCnt, (unsigned)merged.entries.size(), (unsigned)merged.edges.size(), output);
+  return 0;
+}
@@ -0,0 +1,293 @@
+/*
+  ezpp-report -- render a profile saved by ezpp offline.
+
+  Copyright (c) 2010-2017 <http://ez8.co> <orca.zhang@yahoo.com>
+
+  This library is released under the MIT License.
+  Please see LICENSE file or visit https://github.com/ez8-co/ezpp for details.
+ */
+#include "ezpp.hpp"
+
+#define TREE_DEPTH_MAX 32
+
+namespace {
+
+  typedef ezpp::profile::entry entry;
+  typedef ezpp::profile::edge edge;
+
+  bool TotalCostSort(const entry* lhs, const entry* rhs) {
+    return lhs->totalCost > rhs->totalCost;
+  }
+
+  bool EdgeCostSort(const edge* lhs, const edge* rhs) {
+    return lhs->totalCost > rhs->totalCost;
+  }
+
+  std::string label(const entry& e) {
+    return e.ext.empty() ? e.name : e.name + " \"" + e.ext + "\"";
+  }
+
+  // figures are exact microseconds, unlike the rounded times of the runtime report
+  void text(const ezpp::profile& p, long top) {
+    std::vector<const entry*> sorted;
+    for (size_t i = 0; i < p.entries.size(); ++i) {
+      sorted.push_back(&p.entries[i]);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), TotalCostSort);
+    printf("========== Easy Performance Profiler Report ==========\r\n");
+    printf("[Elapsed] %" PRId64 " us, %" PRId64 " process(es), %u site(s)\r\n",
+      p.elapsed, p.processCnt, (unsigned)sorted.size());
+    for (size_t i = 0; i < sorted.size() && (top < 0 || (long)i < top); ++i) {
+      const entry& e = *sorted[i];
+      printf("\r\nNo.%u\r\n", (unsigned)i + 1);
+      printf("[Name] %s (%s:%d)\r\n", label(e).c_str(), e.file.c_str(), e.line);
+      printf("[Call] %" PRId64 "\r\n", e.callCnt);
+      printf("[Time] %" PRId64 " us, self %" PRId64 " us, mean %" PRId64 " us\r\n", e.totalCost, e.selfCost, e.mean());
+      if (e.callCnt > 1) {
+        printf("[Latency] p50 <= %" PRId64 " us, p90 <= %" PRId64 " us, p99 <= %" PRId64 " us\r\n",
+          ezpp::histogram::percentile(e.duration, 0.5), ezpp::histogram::percentile(e.duration, 0.9), e.p99());
+      }
+      if (e.cpuCost) {
+        printf("[CPU] %" PRId64 " us\r\n", e.cpuCost);
+      }
+      if (e.allocCnt) {
+        printf("[Alloc] %" PRId64 " allocs, %" PRId64 " B\r\n", e.allocCnt, e.allocBytes);
+      }
+      for (std::map<unsigned long long, int64_t>::const_iterator it = e.threadCost.begin(); it != e.threadCost.end(); ++it) {
+        printf("  (Thread ID : %llu) %" PRId64 " us\r\n", it->first, it->second);
+      }
+    }
+  }
+
+  void jsonString(const std::string& s) {
+    putchar('"');
+    for (size_t i = 0; i < s.size(); ++i) {
+      unsigned char c = (unsigned char)s[i];
+      if (c == '"' || c == '\\') {
+        printf("\\%c", c);
+      }
+      else if (c < 0x20) {
+        printf("\\u%04x", c);
+      }
+      else {
+        putchar(c);
+      }
+    }
+    putchar('"');
+  }
+
+  void json(const ezpp::profile& p) {
+    printf("{\"elapsed\":%" PRId64 ",\"processes\":%" PRId64 ",\"sites\":[", p.elapsed, p.processCnt);
+    for (size_t i = 0; i < p.entries.size(); ++i) {
+      const entry& e = p.entries[i];
+      printf("%s\n{\"id\":\"%llx\",\"file\":", i ? "," : "", (unsigned long long)e.id);
+      jsonString(e.file);
+      printf(",\"line\":%d,\"name\":", e.line);
+      jsonString(e.name);
+      printf(",\"ext\":");
+      jsonString(e.ext);
+      printf(",\"calls\":%" PRId64 ",\"total\":%" PRId64 ",\"self\":%" PRId64 ",\"cpu\":%" PRId64
+        ",\"allocs\":%" PRId64 ",\"allocBytes\":%" PRId64 ",\"duration\":{",
+        e.callCnt, e.totalCost, e.selfCost, e.cpuCost, e.allocCnt, e.allocBytes);
+      const char* sep = "";
+      for (size_t j = 0; j < EZPP_HIST_BUCKETS; ++j) {
+        if (e.duration[j]) {
+          printf("%s\"%" PRId64 "\":%" PRId64, sep, ezpp::histogram::bucketUpper(j), e.duration[j]);
+          sep = ",";
+        }
+      }
+      printf("},\"threads\":{");
+      sep = "";
+      for (std::map<unsigned long long, int64_t>::const_iterator it = e.threadCost.begin(); it != e.threadCost.end(); ++it) {
+        printf("%s\"%llx\":%" PRId64, sep, it->first, it->second);
+        sep = ",";
+      }
+      printf("}}");
+    }
+    printf("],\"edges\":[");
+    for (size_t i = 0; i < p.edges.size(); ++i) {
+      const edge& ed = p.edges[i];
+      printf("%s\n{\"parent\":\"%llx\",\"child\":\"%llx\",\"calls\":%" PRId64 ",\"total\":%" PRId64 "}",
+        i ? "," : "", (unsigned long long)ed.parent, (unsigned long long)ed.child, ed.callCnt, ed.totalCost);
+    }
+    printf("]}\n");
+  }
+
+  // only caller -> callee pairs are recorded, deeper paths share the time of a site in
+  // proportion to the calls reaching it, like gprof does
+  class call_graph {
+  public:
+    explicit call_graph(const ezpp::profile& p) : _p(p) {
+      for (size_t i = 0; i < p.entries.size(); ++i) {
+        _sites[p.entries[i].id] = &p.entries[i];
+      }
+      for (size_t i = 0; i < p.edges.size(); ++i) {
+        const edge& ed = p.edges[i];
+        if (_sites.count(ed.parent) && _sites.count(ed.child)) {
+          _children[ed.parent].push_back(&ed);
+          if (ed.parent != ed.child) {
+            _called[ed.child] += ed.totalCost;
+          }
+        }
+      }
+      for (std::map<size_t, std::vector<const edge*> >::iterator it = _children.begin(); it != _children.end(); ++it) {
+        std::stable_sort(it->second.begin(), it->second.end(), EdgeCostSort);
+      }
+    }
+
+    // sites entered outside of any other scope, with the time spent there
+    void roots(std::vector<std::pair<const entry*, int64_t> >& out) const {
+      for (size_t i = 0; i < _p.entries.size(); ++i) {
+        const entry& e = _p.entries[i];
+        std::map<size_t, int64_t>::const_iterator it = _called.find(e.id);
+        int64_t time = e.totalCost - (it == _called.end() ? 0 : it->second);
+        if (time > 0) {
+          out.push_back(std::make_pair(&e, time));
+        }
+      }
+    }
+
+    void tree(const entry& e, int64_t time, int64_t calls, int depth, std::vector<size_t>& path, double min) const {
+      double share = _p.elapsed ? (double)time * 100 / _p.elapsed : 0;
+      if (share < min) {
+        return;
+      }
+      printf("%*s%6.2f%%  %" PRId64 " us  %" PRId64 " call(s)  %s (%s:%d)\r\n",
+        depth * 2, "", share, time, calls, label(e).c_str(), e.file.c_str(), e.line);
+      path.push_back(e.id);
+      walk(e, time, depth, path, min, 0);
+      path.pop_back();
+    }
+
+    // folded stacks, "root;child;leaf self-time" per line, for flamegraph.pl and the like
+    void flame(const entry& e, int64_t time, std::string stack, std::vector<size_t>& path) const {
+      std::string frame = label(e);
+      std::replace(frame.begin(), frame.end(), ';', ':');
+      stack += stack.empty() ? frame : ";" + frame;
+      path.push_back(e.id);
+      int64_t self = walk(e, time, (int)path.size(), path, 0, &stack);
+      path.pop_back();
+      if (self > 0) {
+        printf("%s %" PRId64 "\n", stack.c_str(), self);
+      }
+    }
+
+  private:
+    // visits the callees of e for time spent in e on this path, returns what is left to e itself
+    int64_t walk(const entry& e, int64_t time, int depth, std::vector<size_t>& path, double min, const std::string* stack) const {
+      std::map<size_t, std::vector<const edge*> >::const_iterator it = _children.find(e.id);
+      if (it == _children.end() || depth >= TREE_DEPTH_MAX) {
+        return time;
+      }
+      double ratio = e.totalCost > time ? (double)time / e.totalCost : 1;
+      int64_t self = time;
+      for (size_t i = 0; i < it->second.size(); ++i) {
+        const edge& ed = *it->second[i];
+        if (std::find(path.begin(), path.end(), ed.child) != path.end()) {
+          // recursion, already counted by the outer call
+          continue;
+        }
+        int64_t t = (int64_t)(ed.totalCost * ratio);
+        self -= t;
+        const entry& child = *_sites.find(ed.child)->second;
+        if (stack) {
+          flame(child, t, *stack, path);
+        }
+        else {
+          tree(child, t, (int64_t)(ed.callCnt * ratio + 0.5), depth + 1, path, min);
+        }
+      }
+      return self;
+    }
+
+    const ezpp::profile&                           _p;
+    std::map<size_t, const entry*>                 _sites;
+    std::map<size_t, std::vector<const edge*> >    _children;
+    std::map<size_t, int64_t>                      _called;
+  };
+
+  bool RootSort(const std::pair<const entry*, int64_t>& lhs, const std::pair<const entry*, int64_t>& rhs) {
+    return lhs.second > rhs.second;
+  }
+
+  void usage() {
+    fprintf(stderr,
+      "usage: ezpp-report [-v view] [-n count] [-m percent] <profile> [<after>]\r\n"
+      "  renders profiles saved with EZPP_SAVE_PROFILE(file), EZPP_PROFILE=<file> or ezpp-merge\r\n"
+      "  -v  text (default), json, tree, flame (folded stacks) or diff of <profile> and <after>\r\n"
+      "  -n  text: show at most count sites, sorted by total time\r\n"
+      "  -m  tree: hide paths taking less than percent of the elapsed time\r\n");
+  }
+
+}
+
+int main(int argc, char** argv) {
+  std::string view = "text";
+  long top = -1;
+  double min = 0;
+  const char* files[2] = { 0, 0 };
+  int fileCnt = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-v" && i + 1 < argc) {
+      view = argv[++i];
+    }
+    else if (arg == "-n" && i + 1 < argc) {
+      top = atol(argv[++i]);
+    }
+    else if (arg == "-m" && i + 1 < argc) {
+      min = atof(argv[++i]);
+    }
+    else if (arg[0] != '-' && fileCnt < 2) {
+      files[fileCnt++] = argv[i];
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (fileCnt != (view == "diff" ? 2 : 1)) {
+    usage();
+    return 1;
+  }
+
+  ezpp::profile p[2];
+  for (int i = 0; i < fileCnt; ++i) {
+    if (!p[i].load(files[i])) {
+      fprintf(stderr, "ezpp-report: can't load profile %s\r\n", files[i]);
+      return 2;
+    }
+  }
+
+  if (view == "text") {
+    text(p[0], top);
+  }
+  else if (view == "json") {
+    json(p[0]);
+  }
+  else if (view == "tree" || view == "flame") {
+    call_graph g(p[0]);
+    std::vector<std::pair<const entry*, int64_t> > roots;
+    g.roots(roots);
+    std::stable_sort(roots.begin(), roots.end(), RootSort);
+    std::vector<size_t> path;
+    for (size_t i = 0; i < roots.size(); ++i) {
+      const entry& e = *roots[i].first;
+      if (view == "tree") {
+        int64_t calls = e.totalCost ? (int64_t)((double)e.callCnt * roots[i].second / e.totalCost + 0.5) : e.callCnt;
+        g.tree(e, roots[i].second, calls, 0, path, min);
+      }
+      else {
+        g.flame(e, roots[i].second, "", path);
+      }
+    }
+  }
+  else if (view == "diff") {
+    ezpp::profile::output(stdout, p[0], p[1], ezpp::profile::diff(p[0], p[1]));
+  }
+  else {
+    usage();
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+/*
+  ezpp-top -- live view of the ezpp counters of a running process.
+
+  Copyright (c) 2010-2017 <http://ez8.co> <orca.zhang@yahoo.com>
+
+  This library is released under the MIT License.
+  Please see LICENSE file or visit https://github.com/ez8-co/ezpp for details.
+ */
+#include "ezpp.hpp"
+
+#include <signal.h>
+#include <errno.h>
+
+namespace {
+
+  enum sort_key { SORT_CALLS, SORT_TIME, SORT_SELF, SORT_P99 };
+
+  struct row {
+    const ezpp::shm::record* r;
+    ezpp::shm::stat cur;
+    double callRate;  // calls per second
+    double timeRate;  // busy microseconds per second
+    double selfRate;
+    double lastRate;  // calls per second of the refresh before, < 0 if unknown
+    int64_t p99;      // microseconds, of the calls since the last refresh
+  };
+
+  sort_key g_sort = SORT_CALLS;
+
+  bool RowSort(const row& lhs, const row& rhs) {
+    switch (g_sort) {
+      case SORT_TIME: return lhs.timeRate > rhs.timeRate;
+      case SORT_SELF: return lhs.selfRate > rhs.selfRate;
+      case SORT_P99:  return lhs.p99 > rhs.p99;
+      default:        return lhs.callRate > rhs.callRate;
+    }
+  }
+
+  void outputTime(char* buf, size_t size, int64_t us) {
+    if (us < 1000) {
+      snprintf(buf, size, "%" PRId64 " us", us);
+    }
+    else if (us < 1000000) {
+      snprintf(buf, size, "%.2f ms", (double)us / 1000);
+    }
+    else {
+      snprintf(buf, size, "%.2f s", (double)us / 1000000);
+    }
+  }
+
+  void usage() {
+    fprintf(stderr,
+      "usage: ezpp-top [-s calls|time|self|p99] [-d seconds] [-n count] <pid | segment file>\r\n"
+      "  attaches to /dev/shm" EZPP_SHM_PREFIX "<pid> of a process run with EZPP_OPT_SHM or EZPP_SHM=1,\r\n"
+      "  a saved copy of a segment is shown once with rates over the life of the process\r\n"
+      "  -s  sort by calls/s (default), busy time/s, self time/s or p99 since the last refresh\r\n"
+      "  -d  refresh interval, 1 second by default\r\n"
+      "  -n  quit after count refreshes\r\n");
+  }
+
+}
+
+int main(int argc, char** argv) {
+  double interval = 1;
+  int count = -1;
+  const char* target = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-s" && i + 1 < argc) {
+      std::string key = argv[++i];
+      if (key == "calls")     g_sort = SORT_CALLS;
+      else if (key == "time") g_sort = SORT_TIME;
+      else if (key == "self") g_sort = SORT_SELF;
+      else if (key == "p99")  g_sort = SORT_P99;
+      else { usage(); return 1; }
+    }
+    else if (arg == "-d" && i + 1 < argc) {
+      interval = atof(argv[++i]);
+    }
+    else if (arg == "-n" && i + 1 < argc) {
+      count = atoi(argv[++i]);
+    }
+    else if (arg[0] != '-' && !target) {
+      target = argv[i];
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (!target || interval <= 0) {
+    usage();
+    return 1;
+  }
+
+  ezpp::shm::segment seg;
+  char* end = 0;
+  long pid = strtol(target, &end, 10);
+  bool live = *end == '\0';
+  if (live ? !seg.open((int)pid) : !seg.load(target)) {
+    fprintf(stderr, "ezpp-top: no ezpp segment (version %d) for %s\r\n", EZPP_SHM_VERSION, target);
+    return 1;
+  }
+  pid = (long)seg.hdr()->pid;
+
+  std::vector<ezpp::shm::stat> prev;
+  std::vector<double> prevRate;
+  int64_t last = seg.hdr()->started;
+  bool tty = isatty(1) != 0;
+
+  for (int refresh = 0; count < 0 || refresh < count; ++refresh) {
+    if (refresh) {
+      usleep((useconds_t)(interval * 1000000));
+    }
+    bool exited = live && kill((pid_t)pid, 0) && errno == ESRCH;
+
+    // a saved copy has no clock of its own, the latest update closes its window
+    int64_t now = live ? ezpp::time_now() : seg.hdr()->started;
+    std::vector<row> rows;
+    unsigned int cnt = seg.count();
+    prev.resize(cnt);
+    prevRate.resize(cnt, -1);
+    for (unsigned int i = 0; i < cnt; ++i) {
+      row rw;
+      rw.r = &seg.at(i);
+      if (!ezpp::shm::read(*rw.r, rw.cur)) {
+        rw.cur = prev[i];
+      }
+      if (!live && rw.cur.updated > now) {
+        now = rw.cur.updated;
+      }
+      rows.push_back(rw);
+    }
+    double seconds = (double)(now - last) / 1000000;
+    for (size_t i = 0; i < rows.size(); ++i) {
+      row& rw = rows[i];
+      ezpp::shm::stat base = prev[i];
+      if (rw.cur.callCnt < base.callCnt) {
+        // counters restarted after a clear
+        memset(&base, 0, sizeof(base));
+      }
+      int64_t duration[EZPP_HIST_BUCKETS];
+      for (size_t j = 0; j < EZPP_HIST_BUCKETS; ++j) {
+        duration[j] = rw.cur.duration[j] - base.duration[j];
+      }
+      rw.callRate = seconds > 0 ? (rw.cur.callCnt - base.callCnt) / seconds : 0;
+      rw.timeRate = seconds > 0 ? (rw.cur.totalCost - base.totalCost) / seconds : 0;
+      rw.selfRate = seconds > 0 ? (rw.cur.selfCost - base.selfCost) / seconds : 0;
+      rw.lastRate = prevRate[i];
+      rw.p99 = ezpp::histogram::percentile(duration, 0.99);
+      prev[i] = rw.cur;
+      prevRate[i] = rw.callRate;
+    }
+    last = now;
+    std::sort(rows.begin(), rows.end(), RowSort);
+
+    static const char* sortName[] = { "calls/s", "time/s", "self/s", "p99" };
+    if (tty && live) {
+      printf("\033[H\033[2J");
+    }
+    printf("ezpp-top - pid %ld%s, %u site(s), %.1fs window, sorted by %s\r\n\r\n",
+      pid, exited ? " (exited)" : "", cnt, seconds, sortName[g_sort]);
+    printf("%12s %7s %12s %12s %10s %12s  %s\r\n", "CALLS/S", "DELTA", "TIME/S", "SELF/S", "P99", "CALLS", "SITE");
+    for (size_t i = 0; i < rows.size(); ++i) {
+      const row& rw = rows[i];
+      // wide enough for any int64_t in microseconds and its unit
+      char delta[32] = "-", time[32], self[32], p99[32] = "-";
+      if (rw.lastRate > 0) {
+        snprintf(delta, sizeof(delta), "%+.0f%%", (rw.callRate - rw.lastRate) * 100 / rw.lastRate);
+      }
+      outputTime(time, sizeof(time), (int64_t)rw.timeRate);
+      outputTime(self, sizeof(self), (int64_t)rw.selfRate);
+      if (rw.p99) {
+        outputTime(p99, sizeof(p99), rw.p99);
+      }
+      printf("%12.1f %7s %12s %12s %10s %12" PRId64 "  %s", rw.callRate, delta, time, self, p99, rw.cur.callCnt, rw.r->name);
+      if (rw.r->ext[0]) {
+        printf(" \"%s\"", rw.r->ext);
+      }
+      printf(" (%s:%d)\r\n", rw.r->file, rw.r->line);
+    }
+    fflush(stdout);
+    if (exited || !live) {
+      break;
+    }
+  }
+  return 0;
+}